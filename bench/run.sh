@@ -0,0 +1,47 @@
+#!/bin/sh
+#Builds one interpreter per variant and prints the best wall time (seconds) of each
+#benchmark script for every column.
+#Usage: bench/run.sh [runs]
+
+cd "$(dirname "$0")/.." || exit 1
+CC=${CC:-cc}
+RUNS=${1:-5}
+OUT=${TMPDIR:-/tmp}/loxbench
+mkdir -p "$OUT"
+
+#name:extra compiler flags
+VARIANTS="switch:-DNO_COMPUTED_GOTO goto: nanbox:-DNAN_BOXING"
+#name:variant:interpreter flags (the register column compares the two backends on one build)
+COLUMNS="switch:switch: goto:goto: register:goto:--register nanbox:nanbox:"
+
+for variant in $VARIANTS; do
+	name=${variant%%:*}
+	flags=${variant#*:}
+	$CC -O2 -w -DNDEBUG $flags *.c -o "$OUT/$name" -lm || exit 1
+done
+
+bestTime() {
+	best=""
+	i=0
+	while [ $i -lt "$RUNS" ]; do
+		start=$(date +%s.%N)
+		"$@" > /dev/null
+		end=$(date +%s.%N)
+		best=$(echo "$start $end $best" | awk '{ t = $2 - $1; if ($3 == "" || t < $3) printf "%.3f", t; else printf "%.3f", $3 }')
+		i=$((i + 1))
+	done
+	echo "$best"
+}
+
+printf "%-16s" "script"
+for column in $COLUMNS; do printf "%10s" "${column%%:*}"; done
+printf "\n"
+
+for script in bench/*.lox; do
+	printf "%-16s" "$(basename "$script" .lox)"
+	for column in $COLUMNS; do
+		rest=${column#*:}
+		printf "%10s" "$(bestTime "$OUT/${rest%%:*}" ${rest#*:} "$script")"
+	done
+	printf "\n"
+done
@@ -43,3 +43,90 @@ int addConstant(Chunk* chunk, Value constant)
 	pop();
 	return chunk->constants.count - 1;
 }
+
+int instructionLength(Chunk* chunk, int offset)
+{
+	switch (chunk->code[offset])
+	{
+	case OP_CONSTANT:
+	case OP_CLOSURE_SHARED:
+	case OP_GET_LOCAL:
+	case OP_SET_LOCAL:
+	case OP_GET_UPVALUE:
+	case OP_GET_CAPTURED:
+	case OP_SET_UPVALUE:
+	case OP_CLASS:
+	case OP_METHOD:
+	case OP_CALL:
+	case OP_TAIL_CALL:
+	case OP_SET_LOCAL_POP:
+	case OP_ADD_SET_LOCAL:
+	case OP_ADD_SET_UPVALUE:
+		return 2;
+
+	case OP_JUMP:
+	case OP_JUMP_IF_FALSE:
+	case OP_LOOP:
+	case OP_JUMP_IF_FALSE_POP:
+	case OP_GET_LOCAL_CONSTANT:
+	case OP_GET_LOCAL_GET_LOCAL:
+	case OP_R_MOVE:
+	case OP_R_LOADK:
+	case OP_INC_LOCAL:
+	case OP_INC_UPVALUE:
+		return 3;
+
+	//16 bit global slot
+	case OP_DEFINE_GLOBAL:
+	case OP_GET_GLOBAL:
+	case OP_SET_GLOBAL:
+	case OP_ADD_SET_GLOBAL:
+		return 3;
+	case OP_INC_GLOBAL:
+		return 4;
+
+	//Name constant and a 16 bit inline cache index
+	case OP_GET_PROPERTY:
+	case OP_SET_PROPERTY:
+	case OP_ADD_SET_PROPERTY:
+	case OP_GET_SUPER:
+		return 4;
+	case OP_GET_LOCAL_PROPERTY:
+	case OP_INC_PROPERTY:
+	case OP_INVOKE:
+	case OP_TAIL_INVOKE:
+	case OP_SUPER_INVOKE:
+		return 5;
+	//Struct field offset first
+	case OP_GET_FIELD:
+	case OP_SET_FIELD:
+		return 5;
+	case OP_GET_LOCAL_FIELD:
+		return 6;
+
+	case OP_R_ADD:
+	case OP_R_SUBTRACT:
+	case OP_R_MULTIPLY:
+	case OP_R_DIVIDE:
+	case OP_R_ADDK:
+	case OP_R_SUBTRACTK:
+	case OP_R_MULTIPLYK:
+	case OP_R_DIVIDEK:
+	case OP_R_MOD:
+	case OP_R_MODK:
+		return 4;
+
+	case OP_FOR_PREP:
+		return 6;
+	case OP_FOR_LOOP:
+		return 7;
+
+	case OP_CLOSURE: {
+		ObjFunction* function = AS_FUNCTION(chunk->constants.values[chunk->code[offset + 1]]);
+		return 2 + 2 * function->upvalueCount;
+	}
+
+	default:
+		return 1;
+	}
+}
@@ -23,7 +23,17 @@ typedef enum {
 	OP_NOT,
 	OP_NEGATE,
 
+	//Integer only, except ~/ which truncates doubles too
+	OP_INT_DIVIDE,
+	OP_BIT_AND,
+	OP_BIT_OR,
+	OP_BIT_XOR,
+	OP_SHIFT_LEFT,
+	OP_SHIFT_RIGHT,
+	OP_BIT_NOT,
+
 	OP_POP,
+	OP_DUP,
 
 	OP_DEFINE_GLOBAL,
 	OP_GET_GLOBAL,
@@ -38,20 +48,105 @@ typedef enum {
 	OP_LOOP,
 
 	OP_CLOSURE,
+	//Closure of a function without upvalues, created once and reused
+	OP_CLOSURE_SHARED,
 	OP_SET_UPVALUE,
 	OP_GET_UPVALUE,
+	//Upvalue captured by value, for a variable that is never reassigned
+	OP_GET_CAPTURED,
 	OP_CLOSE_UPVALUE,
 
 	OP_CLASS,
 	OP_SET_PROPERTY,
 	OP_GET_PROPERTY,
 	OP_METHOD,
+	OP_INHERIT,
+	//super.name and super.name(args): name, cache[, argument count]
+	OP_GET_SUPER,
+	OP_SUPER_INVOKE,
+	//Struct field at the offset the compiler found for the name: offset, name, cache.
+	//Any other receiver falls back to the property path.
+	OP_GET_FIELD,
+	OP_SET_FIELD,
 
-	OP_SET_DEFAULT,
 	OP_CALL,
-	OP_RETURN
+	OP_TAIL_CALL,
+	//obj.method(args) without the bound method: name, cache, argument count
+	OP_INVOKE,
+	OP_TAIL_INVOKE,
+	OP_RETURN,
+
+	//Superinstructions, only produced by optimizeFunction()
+	OP_GET_LOCAL_CONSTANT,
+	OP_GET_LOCAL_GET_LOCAL,
+	OP_GET_LOCAL_PROPERTY,
+	OP_GET_LOCAL_FIELD,
+	OP_SET_LOCAL_POP,
+	OP_JUMP_IF_FALSE_POP,
+
+	//Quickened forms, written over the generic opcode at runtime once it has seen two ints or two doubles
+	OP_GREATER_NUM,
+	OP_LESS_NUM,
+	OP_ADD_NUM,
+	OP_SUBTRACT_NUM,
+	OP_MULTIPLY_NUM,
+	OP_DIVIDE_NUM,
+	OP_GREATER_INT,
+	OP_LESS_INT,
+	OP_ADD_INT,
+	OP_SUBTRACT_INT,
+	OP_MULTIPLY_INT,
+
+	//Register backend (--register): three-address ops on frame slots, dst first.
+	//The K forms take a constant index as their last operand.
+	OP_R_MOVE,
+	OP_R_LOADK,
+	OP_R_ADD,
+	OP_R_SUBTRACT,
+	OP_R_MULTIPLY,
+	OP_R_DIVIDE,
+	OP_R_MOD,
+	OP_R_ADDK,
+	OP_R_SUBTRACTK,
+	OP_R_MULTIPLYK,
+	OP_R_DIVIDEK,
+	OP_R_MODK,
+
+	//Counted for-loops: slot, limit, flags, [step constant,] jump
+	OP_FOR_PREP,
+	OP_FOR_LOOP,
+
+	//Compound assignment, leaving the new value on the stack. INC takes a signed byte delta,
+	//ADD_SET adds the value on top of the stack.
+	OP_INC_LOCAL,
+	OP_INC_UPVALUE,
+	OP_INC_GLOBAL,
+	OP_INC_PROPERTY,
+	OP_ADD_SET_LOCAL,
+	OP_ADD_SET_UPVALUE,
+	OP_ADD_SET_GLOBAL,
+	OP_ADD_SET_PROPERTY
 } OpCode;
 
+//First operand byte of each upvalue OP_CLOSURE captures
+typedef enum {
+	//An upvalue of the enclosing closure, taken as it is
+	CAPTURE_UPVALUE,
+	//A local of the enclosing function, shared through an ObjUpvalue
+	CAPTURE_LOCAL,
+	//A local that is never reassigned, copied into the closure
+	CAPTURE_LOCAL_VALUE
+} CaptureKind;
+
+//Flags operand of OP_FOR_PREP and OP_FOR_LOOP. The condition is `slot < limit`, or `slot > limit`
+//with FOR_GREATER, negated with FOR_NOT (so <= is `!(slot > limit)`, as GREATER NOT would do it).
+#define FOR_GREATER 0x1
+#define FOR_NOT 0x2
+//limit is a constant index instead of a local slot
+#define FOR_CONSTANT_LIMIT 0x4
+//The step is subtracted instead of added
+#define FOR_SUBTRACT 0x8
+
 typedef struct {
 	int count;
 	int capacity;
@@ -65,5 +160,7 @@ void writeChunk(Chunk* chunk, uint8_t byte, int line);
 void freeChunk(Chunk* chunk);
 
 int addConstant(Chunk* chunk, Value constant);
+//Size in bytes of the instruction at offset, operands included
+int instructionLength(Chunk* chunk, int offset);
 
 #endif chunk_h
\ No newline at end of file
@@ -5,10 +5,24 @@
 #include <stddef.h>
 #include <stdint.h>
 
-#define DEBUG_TRACE_EXECUTION
-
+#ifndef NDEBUG
 //#define DEBUG_STRESS_GC
 #define DEBUG_LOG_GC
+#endif
+
+//Counts adjacent opcode pairs and triples executed by run() and prints them from freeVM().
+//This is what the superinstruction set in chunk.h was chosen from.
+//#define PROFILE_OPCODES
+
+//Labels-as-values dispatch in run(). Only GCC and Clang support it; everything else
+//(and builds defining NO_COMPUTED_GOTO) falls back to the portable switch.
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(NO_COMPUTED_GOTO)
+#define COMPUTED_GOTO
+#endif
+
+//Values packed into one 64 bit word (value.h): numbers as themselves, everything else inside
+//the quiet NaNs. Can also be turned on from the command line with -DNAN_BOXING.
+//#define NAN_BOXING
 
 
 
@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -6,6 +7,8 @@
 #include "compiler.h"
 #include "lexer.h"
 #include "debug.h"
+#include "optimizer.h"
+#include "vm.h"
 
 #define UINT8_COUNT (UINT8_MAX + 1)
 
@@ -15,6 +18,8 @@ typedef struct{
 	bool hadError;
 	//Panic flag has yet to be cleared and synchronized
 	bool panicMode;
+	//Braces opened and not yet closed, up to previous
+	int braceDepth;
 } Parser;
 
 typedef enum {
@@ -24,9 +29,13 @@ typedef enum {
 	PREC_AND, // and
 	PREC_EQUALITY, // == !=
 	PREC_COMPARISON, // < > <= >=
+	PREC_BIT_OR, // |
+	PREC_BIT_XOR, // ^
+	PREC_BIT_AND, // &
+	PREC_SHIFT, // << >>
 	PREC_TERM, // + -
-	PREC_FACTOR, // * /
-	PREC_UNARY, // ! -
+	PREC_FACTOR, // * / ~/ %
+	PREC_UNARY, // ! - ~
 	PREC_CALL, // . ()
 	PREC_PRIMARY
 } Precedence;
@@ -43,13 +52,21 @@ Parser parser;
 typedef struct {
 	Token name;
 	int depth;
+	//parser.braceDepth where it was declared, the body's for parameters
+	int braceDepth;
+	//Written by code compiled so far
+	bool isAssigned;
 
+	//Captured through an ObjUpvalue, closed when it goes out of scope
 	bool isCaptured;
+	//Captured by value, it is never reassigned
+	bool isCopied;
 } Local;
 
 typedef struct {
 	uint8_t index;
 	bool isLocal;
+	bool isCopied;
 } Upvalue;
 
 typedef enum {
@@ -70,10 +87,22 @@ typedef struct {
 	Local locals[UINT8_COUNT];
 	int localCount;
 	int scopeDepth;
+	//Offset of the last OP_CALL emitted, for spotting calls in tail position
+	int lastCall;
 } Compiler;
 
 Compiler* current = NULL;
 
+typedef struct ClassCompiler {
+	struct ClassCompiler* enclosing;
+	bool hasSuperclass;
+} ClassCompiler;
+
+ClassCompiler* currentClass = NULL;
+
+//Field name -> offset (as a number) in every struct declared so far that has it, -1 when two disagree
+Table fieldOffsets;
+
 Chunk* compillingChunk;
 static Chunk* currentChunk() {
 	return &current->function->chunk;
@@ -111,6 +140,8 @@ static void error(char* message) {
 #pragma region Parsing helpers
 static void advance() {
 	parser.previous = parser.current;
+	if (parser.previous.type == TOKEN_LEFT_BRACE) parser.braceDepth++;
+	else if (parser.previous.type == TOKEN_RIGHT_BRACE) parser.braceDepth--;
 	for (;;) {
 		parser.current = lexToken();
 
@@ -164,18 +195,51 @@ static uint8_t makeConstant(Value value) {
 	}
 	return (uint8_t)constant;
 }
+//New inline cache for a property instruction of the current function
+static uint16_t makeCache() {
+	ObjFunction* function = current->function;
+	if (function->cacheCount == UINT16_MAX) {
+		error("Too many property accesses in one function.");
+		return 0;
+	}
+
+	if (function->cacheCount >= function->cacheCapacity) {
+		int oldCapacity = function->cacheCapacity;
+		function->cacheCapacity = GROW_CAPACITY(oldCapacity);
+		function->caches = GROW_ARRAY(PropertyCache, function->caches, oldCapacity, function->cacheCapacity);
+	}
+	memset(&function->caches[function->cacheCount], 0, sizeof(PropertyCache));
+	return (uint16_t)function->cacheCount++;
+}
+//Variable and property access. Globals take a 16 bit slot, property instructions carry their
+//inline cache index after the name.
+static void emitAccess(uint8_t op, int arg) {
+	if (op == OP_DEFINE_GLOBAL || op == OP_GET_GLOBAL || op == OP_SET_GLOBAL || op == OP_INC_GLOBAL || op == OP_ADD_SET_GLOBAL) {
+		emitByte(op);
+		emitBytes((arg >> 8) & 0xff, arg & 0xff);
+		return;
+	}
+
+	emitBytes(op, (uint8_t)arg);
+	if (op == OP_GET_PROPERTY || op == OP_SET_PROPERTY || op == OP_INC_PROPERTY || op == OP_ADD_SET_PROPERTY
+		|| op == OP_INVOKE || op == OP_GET_SUPER || op == OP_SUPER_INVOKE) {
+		uint16_t cache = makeCache();
+		emitBytes((cache >> 8) & 0xff, cache & 0xff);
+	}
+}
 #pragma endregion
 
 #pragma region Initialization and ending
 static ObjFunction* endCompile() {
 	emitReturn();
 	ObjFunction* function = current->function;
-#ifdef DEBUG_TRACE_EXECUTION
 	if (!parser.hadError) {
+		optimizeFunction(function);
+	}
+	if (vm.traceExecution && !parser.hadError) {
 		disassembleChunk(currentChunk(),
 			function->name != NULL ? function->name->chars: "<script>");
 	}
-#endif // DEBUG_TRACE_EXECUTION
 
 	current = current->enclosing;
 	return function;
@@ -188,15 +252,16 @@ static void initCompiler(Compiler* compiler, FunctionType type) {
 
 	compiler->localCount = 0;
 	compiler->scopeDepth = 0;
+	compiler->lastCall = -1;
 
 	compiler->function = newFunction();
+	//Roots the function before its name is allocated
+	current = compiler;
 
 	if (type != TYPE_SCRIPT) {
 		compiler->function->name = copyString(parser.previous.lexemeStart, parser.previous.length);
 	}
 
-	current = compiler;
-
 	Local* local = &current->locals[current->localCount++];
 	local->depth = 0;
 
@@ -209,7 +274,10 @@ static void initCompiler(Compiler* compiler, FunctionType type) {
 		local->name.lexemeStart = "this";
 		local->name.length = 4;
 	}
+	local->braceDepth = parser.braceDepth;
+	local->isAssigned = false;
 	local->isCaptured = false;
+	local->isCopied = false;
 }
 #pragma endregion
 
@@ -218,6 +286,7 @@ static void statement();
 static void declaration();
 static ParseRule* getRule(TokenType type);
 static void parsePrecedence(Precedence precedence);
+static bool lowerToRegisters(int start, int depth, bool discardResult);
 
 static void beginScope() {
 	current->scopeDepth++;
@@ -253,6 +322,22 @@ static uint8_t identifierConstant(Token* name) {
 	return makeConstant(OBJ_VAL(copyString(name->lexemeStart, name->length)));; 	
 }
 
+static uint16_t globalVariable(Token* name) {
+	int slot = globalSlot(copyString(name->lexemeStart, name->length));
+	if (slot > UINT16_MAX) {
+		error("Too many global variables.");
+		return 0;
+	}
+	return (uint16_t)slot;
+}
+
+static Token syntheticToken(char* text) {
+	Token token;
+	token.lexemeStart = text;
+	token.length = (int)strlen(text);
+	return token;
+}
+
 static bool identifiersEqual(Token* a, Token* b) {
 	if (a->length != b->length)	return false;
 	return memcmp(a->lexemeStart, b->lexemeStart, a->length) == 0;
@@ -279,11 +364,14 @@ static void addLocal(Token* name) {
 	Local* local = &current->locals[current->localCount++];
 	local->name = *name;
 	local->depth = -1;
+	local->braceDepth = parser.braceDepth;
+	local->isAssigned = false;
 	local->isCaptured = false;
+	local->isCopied = false;
 	//local->depth = current->scopeDepth;
 }
 
-static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal) {
+static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal, bool isCopied) {
 	int upvalueCount = compiler->function->upvalueCount;
 	
 	for (int i = 0;i < upvalueCount;i++) {
@@ -300,22 +388,68 @@ static int addUpvalue(Compiler* compiler, uint8_t index, bool isLocal) {
 
 	compiler->upvalues[upvalueCount].index = index;
 	compiler->upvalues[upvalueCount].isLocal = isLocal;
+	compiler->upvalues[upvalueCount].isCopied = isCopied;
 	return compiler->function->upvalueCount++;
 }
 
+static bool isAssignment(TokenType type) {
+	return type == TOKEN_EQUAL || type == TOKEN_PLUS_EQUAL || type == TOKEN_MINUS_EQUAL || type == TOKEN_STAR_EQUAL
+		|| type == TOKEN_SLASH_EQUAL || type == TOKEN_PERCENT_EQUAL || type == TOKEN_PLUS_PLUS || type == TOKEN_MINUS_MINUS;
+}
+
+//Scans the source from parser.previous to the brace that takes the depth below endDepth for an
+//assignment to name. Any variable of that name counts, shadowing is not worked out.
+static bool assignedAhead(Token* name, int endDepth) {
+	Lexer saved = saveLexer();
+	int depth = parser.braceDepth;
+	Token before = parser.previous;
+	Token previous = parser.previous;
+	Token token = parser.current;
+	before.type = TOKEN_EOF;
+
+	bool assigned = false;
+	for (;;) {
+		if (previous.type == TOKEN_IDENTIFIER && before.type != TOKEN_DOT && isAssignment(token.type)
+			&& identifiersEqual(name, &previous)) {
+			assigned = true;
+			break;
+		}
+		if (token.type == TOKEN_EOF) break;
+		if (token.type == TOKEN_LEFT_BRACE) depth++;
+		else if (token.type == TOKEN_RIGHT_BRACE && --depth < endDepth) break;
+
+		before = previous;
+		previous = token;
+		token = lexToken();
+	}
+
+	restoreLexer(saved);
+	return assigned;
+}
+
+//A local is copied into closures when neither the code compiled so far nor the rest of its scope
+//assigns it. The first capture decides, for every closure.
 static int resolveUpvalue(Compiler* compiler, Token* name) {
 	if (compiler->enclosing == NULL) return -1;
 
-	int local = resolveLocal(compiler->enclosing, name);
+	Compiler* enclosing = compiler->enclosing;
+	int local = resolveLocal(enclosing, name);
 	if (local != -1) {
-		Compiler* enclosing = compiler->enclosing;
-		enclosing->locals[local].isCaptured = true;
-		return addUpvalue(compiler, (uint8_t)local, true);
+		Local* captured = &enclosing->locals[local];
+		if (!captured->isCaptured && !captured->isCopied) {
+			if (captured->isAssigned || assignedAhead(name, captured->braceDepth)) {
+				captured->isCaptured = true;
+			}
+			else {
+				captured->isCopied = true;
+			}
+		}
+		return addUpvalue(compiler, (uint8_t)local, true, captured->isCopied);
 	}
 
-	int upvalue = resolveUpvalue(compiler->enclosing, name);
+	int upvalue = resolveUpvalue(enclosing, name);
 	if (upvalue != -1) {
-		return addUpvalue(compiler, (uint8_t)upvalue, false);
+		return addUpvalue(compiler, (uint8_t)upvalue, false, enclosing->upvalues[upvalue].isCopied);
 	}
 
 	return - 1;
@@ -339,13 +473,13 @@ static void declareVariable() {
 	addLocal(name);
 }
 
-static uint8_t parseVariable(char* message) {
+static uint16_t parseVariable(char* message) {
 	consume(TOKEN_IDENTIFIER, message);
 
 	declareVariable();
-	if (current->scopeDepth > 0)	return;
+	if (current->scopeDepth > 0)	return 0;
 
-	return identifierConstant(&parser.previous);
+	return globalVariable(&parser.previous);
 }
 
 static void markInitialized() {
@@ -353,19 +487,25 @@ static void markInitialized() {
 	current->locals[current->localCount - 1].depth = current->scopeDepth;
 }
 
-static void defineVariable(uint8_t global) {
+static void defineVariable(uint16_t global) {
 	if (current->scopeDepth > 0) {
 		markInitialized();
 		return;
 	}
-	emitBytes(OP_DEFINE_GLOBAL, global);
+	emitAccess(OP_DEFINE_GLOBAL, global);
 }
 
 static void varDeclaration() {
-	uint8_t global = parseVariable("Expect variable name.");
+	uint16_t global = parseVariable("Expect variable name.");
 	
-	if (match(TOKEN_EQUAL))
+	if (match(TOKEN_EQUAL)) {
+		int start = currentChunk()->count;
 		expression();
+		if (current->scopeDepth > 0) {
+			//The new local already has its slot, the initializer is pushed into it
+			lowerToRegisters(start, current->localCount - 1, false);
+		}
+	}
 	else
 	{
 		emitByte(OP_NIL);
@@ -374,6 +514,89 @@ static void varDeclaration() {
 	defineVariable(global);
 }
 
+#pragma region Compound assignment
+static bool matchCompoundAssignment() {
+	return match(TOKEN_PLUS_EQUAL) || match(TOKEN_MINUS_EQUAL) || match(TOKEN_STAR_EQUAL)
+		|| match(TOKEN_SLASH_EQUAL) || match(TOKEN_PERCENT_EQUAL);
+}
+
+static uint8_t compoundOperator(TokenType type) {
+	switch (type)
+	{
+	case TOKEN_PLUS_EQUAL: return OP_ADD;
+	case TOKEN_MINUS_EQUAL: return OP_SUBTRACT;
+	case TOKEN_STAR_EQUAL: return OP_MULTIPLY;
+	case TOKEN_SLASH_EQUAL: return OP_DIVIDE;
+	case TOKEN_PERCENT_EQUAL: return OP_MOD;
+
+	default: return 0; //Unreachable
+	}
+}
+
+//The right-hand side is a single int constant that fits the delta byte of the INC ops.
+//Doubles are left alone: the INC ops add an int, which would keep an int target an int.
+static bool smallIntegerConstant(int rhsStart, int* outValue) {
+	Chunk* chunk = currentChunk();
+	if (chunk->count - rhsStart != 2 || chunk->code[rhsStart] != OP_CONSTANT) return false;
+
+	Value value = chunk->constants.values[chunk->code[rhsStart + 1]];
+	if (!IS_INT(value)) return false;
+	int64_t number = AS_INT(value);
+	if (number < -INT8_MAX || number > INT8_MAX) return false;
+
+	*outValue = (int)number;
+	return true;
+}
+
+//Code from start on cannot call anything or assign, so it does not matter whether the
+//target of a compound assignment is read before or after it
+static bool isPureExpression(int start) {
+	Chunk* chunk = currentChunk();
+	for (int offset = start; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+		switch (chunk->code[offset])
+		{
+		case OP_CONSTANT: case OP_NIL: case OP_TRUE: case OP_FALSE:
+		case OP_GET_LOCAL: case OP_GET_UPVALUE: case OP_GET_CAPTURED: case OP_GET_GLOBAL: case OP_GET_PROPERTY: case OP_GET_FIELD:
+		case OP_EQUAL: case OP_GREATER: case OP_LESS:
+		case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_MOD:
+		case OP_INT_DIVIDE: case OP_BIT_AND: case OP_BIT_OR: case OP_BIT_XOR: case OP_SHIFT_LEFT: case OP_SHIFT_RIGHT:
+		case OP_NOT: case OP_NEGATE: case OP_BIT_NOT:
+			break;
+		default:
+			return false;
+		}
+	}
+	return true;
+}
+
+//Finishes `target op= rhs` once the read of the target (from getStart) and rhs (from rhsStart)
+//are emitted. Adding or subtracting a small whole constant becomes incOp, adding anything else
+//that is pure becomes addSetOp. Everything else stays get / op / set.
+static void compoundAssignment(uint8_t op, uint8_t setOp, uint8_t incOp, uint8_t addSetOp, int arg, int getStart, int rhsStart) {
+	Chunk* chunk = currentChunk();
+	int delta;
+	if ((op == OP_ADD || op == OP_SUBTRACT) && smallIntegerConstant(rhsStart, &delta)) {
+		chunk->count = getStart;
+		emitAccess(incOp, arg);
+		emitByte((uint8_t)(op == OP_ADD ? delta : -delta));
+		return;
+	}
+
+	if (op == OP_ADD && isPureExpression(rhsStart)) {
+		//addSetOp reads the target itself, after the right-hand side
+		int rhsLength = chunk->count - rhsStart;
+		memmove(chunk->code + getStart, chunk->code + rhsStart, rhsLength);
+		memmove(chunk->lines + getStart, chunk->lines + rhsStart, rhsLength * sizeof(int));
+		chunk->count = getStart + rhsLength;
+		emitAccess(addSetOp, arg);
+		return;
+	}
+
+	emitByte(op);
+	emitAccess(setOp, arg);
+}
+#pragma endregion
+
 static void namedVariable(Token* name, bool canAssign) {
 	uint8_t getOp, setOp;
 	int arg = resolveLocal(current, name);
@@ -381,61 +604,85 @@ static void namedVariable(Token* name, bool canAssign) {
 	if (arg != -1) {
 		getOp = OP_GET_LOCAL;
 		setOp = OP_SET_LOCAL;
+		if (canAssign && isAssignment(parser.current.type)) {
+			current->locals[arg].isAssigned = true;
+		}
 	}
 	else if ((arg = resolveUpvalue(current, name)) != -1) {
-		getOp = OP_GET_UPVALUE;
+		getOp = current->upvalues[arg].isCopied ? OP_GET_CAPTURED : OP_GET_UPVALUE;
 		setOp = OP_SET_UPVALUE;
 	}
 	else {
 		getOp = OP_GET_GLOBAL;
 		setOp = OP_SET_GLOBAL;
-		arg = identifierConstant(name);
+		arg = globalVariable(name);
 	}
 
+	uint8_t incOp = setOp == OP_SET_LOCAL ? OP_INC_LOCAL : setOp == OP_SET_UPVALUE ? OP_INC_UPVALUE : OP_INC_GLOBAL;
+	uint8_t addSetOp = setOp == OP_SET_LOCAL ? OP_ADD_SET_LOCAL : setOp == OP_SET_UPVALUE ? OP_ADD_SET_UPVALUE : OP_ADD_SET_GLOBAL;
+
 	//Order below matters
 	if (canAssign && match(TOKEN_EQUAL)) {
 		expression();
-		emitBytes(setOp, arg);
+		emitAccess(setOp, arg);
 	}
-	else if (canAssign &&
-		(match(TOKEN_PLUS_EQUAL) || match(TOKEN_MINUS_EQUAL) || match(TOKEN_STAR_EQUAL) 
-			|| match(TOKEN_SLASH_EQUAL) || match(TOKEN_PERCENT_EQUAL))) {
-
-		uint8_t op;
-		switch (parser.previous.type)
-		{
-		case TOKEN_PLUS_EQUAL: op = OP_ADD; break;
-		case TOKEN_MINUS_EQUAL: op = OP_SUBTRACT; break;
-		case TOKEN_STAR_EQUAL: op = OP_MULTIPLY; break;
-		case TOKEN_SLASH_EQUAL: op = OP_DIVIDE; break;
-		case TOKEN_PERCENT_EQUAL: op = OP_MOD; break;
-
-		default: op = 0; break; //Unreachable
-		}
-		emitBytes(getOp, arg);
+	else if (canAssign && matchCompoundAssignment()) {
+		uint8_t op = compoundOperator(parser.previous.type);
+		int getStart = currentChunk()->count;
+		emitAccess(getOp, arg);
+		int rhsStart = currentChunk()->count;
 		expression();
 
-		emitByte(op);
-		emitBytes(setOp, arg);
+		compoundAssignment(op, setOp, incOp, addSetOp, arg, getStart, rhsStart);
 	}
 	else if (canAssign && (match(TOKEN_PLUS_PLUS) || match(TOKEN_MINUS_MINUS))) {
-		emitBytes(getOp, arg);
-		int sign = parser.previous.type == TOKEN_PLUS_PLUS ? 1 : -1;
-		emitBytes(OP_CONSTANT, makeConstant(NUMBER_VAL(sign)));
-		emitByte(OP_ADD);
-		emitBytes(setOp, arg);
+		emitAccess(incOp, arg);
+		emitByte(parser.previous.type == TOKEN_PLUS_PLUS ? 1 : (uint8_t)-1);
 	}
 	else {
-		emitBytes(getOp, arg);
+		emitAccess(getOp, arg);
 	}
 }
 
 #pragma endregion
 
 #pragma region Functions and return
+//Default of the parameter just declared. A constant is stored in the function, anything else
+//becomes code that sets the parameter. A call giving n defaults starts at the code of default n.
+static void defaultParameter(int* entries) {
+	ObjFunction* function = current->function;
+	Chunk* chunk = currentChunk();
+	int start = chunk->count;
+	entries[function->defaults] = start;
+	expression();
+
+	Value value = NIL_VAL;
+	bool constant = true;
+	if (chunk->count - start == 2 && chunk->code[start] == OP_CONSTANT) {
+		value = chunk->constants.values[chunk->code[start + 1]];
+	}
+	else if (chunk->count - start == 1 && (chunk->code[start] == OP_TRUE || chunk->code[start] == OP_FALSE)) {
+		value = BOOL_VAL(chunk->code[start] == OP_TRUE);
+	}
+	else if (chunk->count - start != 1 || chunk->code[start] != OP_NIL) {
+		constant = false;
+	}
+
+	if (constant) {
+		chunk->count = start;
+	}
+	else {
+		emitBytes(OP_SET_LOCAL, (uint8_t)(current->localCount - 1));
+		emitByte(OP_POP);
+	}
+	writeValueArray(&function->defaultValues, value);
+	function->defaults++;
+}
+
 static void function(FunctionType type) {
 	Compiler compiler;
 	initCompiler(&compiler, type);
+	int entries[UINT8_COUNT + 1];
 
 	beginScope();
 
@@ -451,10 +698,7 @@ static void function(FunctionType type) {
 			defineVariable(parameter);
 
 			if (match(TOKEN_EQUAL)) {
-				expression();
-				emitBytes(OP_SET_DEFAULT, current->function->defaults);
-
-				current->function->defaults++;
+				defaultParameter(entries);
 				break;
 			}
 
@@ -472,29 +716,42 @@ static void function(FunctionType type) {
 
 				consume(TOKEN_EQUAL, "Default parameters must be at the end.");
 
-				expression();
-				emitBytes(OP_SET_DEFAULT, current->function->defaults);
-
-				current->function->defaults++;
+				defaultParameter(entries);
 			} while (match(TOKEN_COMMA));
 		}
 	}
 
+	ObjFunction* compiling = current->function;
+	if (compiling->defaults > 0) {
+		entries[compiling->defaults] = currentChunk()->count;
+		compiling->entries = ALLOCATE(int, compiling->defaults + 1);
+		memcpy(compiling->entries, entries, sizeof(int) * (compiling->defaults + 1));
+	}
+
 	consume(TOKEN_RIGHT_PAREN, "Expect ')' after parameters.");
 	consume(TOKEN_LEFT_BRACE, "Expect '{' before function body.");
+	//Parameters go out of scope with the body, so a search for their assignments ends at its '}'
+	for (int i = 0; i < current->localCount; i++) {
+		current->locals[i].braceDepth = parser.braceDepth;
+	}
 
 	block();
 
 	ObjFunction* function = endCompile();
+	if (function->upvalueCount == 0) {
+		emitBytes(OP_CLOSURE_SHARED, makeConstant(OBJ_VAL(function)));
+		return;
+	}
 	emitBytes(OP_CLOSURE, makeConstant(OBJ_VAL(function)));
 	for (int i = 0; i < function->upvalueCount; i++) {
-		emitByte(compiler.upvalues[i].isLocal ? 1 : 0);
+		Upvalue* upvalue = &compiler.upvalues[i];
+		emitByte(!upvalue->isLocal ? CAPTURE_UPVALUE : upvalue->isCopied ? CAPTURE_LOCAL_VALUE : CAPTURE_LOCAL);
 		emitByte(compiler.upvalues[i].index);
 	}
 }
 
 static void functionDeclaration() {
-	uint8_t global = parseVariable("Expect function name.");
+	uint16_t global = parseVariable("Expect function name.");
 	markInitialized();
 	function(TYPE_FUNCTION);
 	defineVariable(global);
@@ -518,6 +775,7 @@ static uint8_t argumentList() {
 
 static void call(bool canAssign) {
 	uint8_t args = argumentList();
+	current->lastCall = currentChunk()->count;
 	emitBytes(OP_CALL, args);
 }
 
@@ -534,6 +792,13 @@ static void returnStatement() {
 	else{
 		expression();
 		consume(TOKEN_SEMICOLON, "Expect ';' after return value.");
+		//The call's result is the return value: let the callee take over this frame.
+		//OP_RETURN stays for the calls the tail forms make the ordinary way.
+		Chunk* chunk = currentChunk();
+		int lastCall = current->lastCall;
+		if (lastCall != -1 && lastCall + instructionLength(chunk, lastCall) == chunk->count) {
+			chunk->code[lastCall] = chunk->code[lastCall] == OP_INVOKE ? OP_TAIL_INVOKE : OP_TAIL_CALL;
+		}
 		emitByte(OP_RETURN);
 	}
 }
@@ -541,17 +806,57 @@ static void returnStatement() {
 
 #pragma region Classes
 
+//Offset of the field in the structs declared so far, -1 when there is none or they disagree
+static int fieldOffset(Token* name) {
+	Value offset;
+	if (!tableGet(&fieldOffsets, copyString(name->lexemeStart, name->length), &offset)) return -1;
+	return (int)AS_NUMBER(offset);
+}
+
+//OP_GET_FIELD / OP_SET_FIELD where a struct would have the field at a known offset
+static void emitFieldAccess(uint8_t op, uint8_t name, int field) {
+	if (field == -1) {
+		emitAccess(op == OP_GET_FIELD ? OP_GET_PROPERTY : OP_SET_PROPERTY, name);
+		return;
+	}
+	emitBytes(op, (uint8_t)field);
+	uint16_t cache = makeCache();
+	emitByte(name);
+	emitBytes((cache >> 8) & 0xff, cache & 0xff);
+}
+
 static void dot(bool canAssign) {
 	consume(TOKEN_IDENTIFIER, "Expect propery name after '.'");
 	uint8_t name = identifierConstant(&parser.previous);
+	int field = fieldOffset(&parser.previous);
 	
 	if (canAssign && match(TOKEN_EQUAL)) {
 		expression();
-		emitBytes(OP_SET_PROPERTY, name);
+		emitFieldAccess(OP_SET_FIELD, name, field);
+	}
+	else if (canAssign && matchCompoundAssignment()) {
+		uint8_t op = compoundOperator(parser.previous.type);
+		int getStart = currentChunk()->count;
+		emitByte(OP_DUP);
+		emitAccess(OP_GET_PROPERTY, name);
+		int rhsStart = currentChunk()->count;
+		expression();
+
+		compoundAssignment(op, OP_SET_PROPERTY, OP_INC_PROPERTY, OP_ADD_SET_PROPERTY, name, getStart, rhsStart);
+	}
+	else if (canAssign && (match(TOKEN_PLUS_PLUS) || match(TOKEN_MINUS_MINUS))) {
+		emitAccess(OP_INC_PROPERTY, name);
+		emitByte(parser.previous.type == TOKEN_PLUS_PLUS ? 1 : (uint8_t)-1);
+	}
+	else if (match(TOKEN_LEFT_PAREN)) {
+		uint8_t argCount = argumentList();
+		current->lastCall = currentChunk()->count;
+		emitAccess(OP_INVOKE, name);
+		emitByte(argCount);
 	}
 	else
 	{
-		emitBytes(OP_GET_PROPERTY, name);
+		emitFieldAccess(OP_GET_FIELD, name, field);
 	}
 
 }
@@ -577,7 +882,30 @@ static void classDeclaration() {
 
 	emitBytes(OP_CLASS, nameConstant);
 
-	defineVariable(nameConstant);
+	defineVariable(current->scopeDepth > 0 ? 0 : globalVariable(&className));
+
+	ClassCompiler classCompiler;
+	classCompiler.hasSuperclass = false;
+	classCompiler.enclosing = currentClass;
+	currentClass = &classCompiler;
+
+	if (match(TOKEN_LESS)) {
+		consume(TOKEN_IDENTIFIER, "Expect superclass name.");
+		namedVariable(&parser.previous, false);
+		if (identifiersEqual(&className, &parser.previous)) {
+			error("A class can't inherit from itself.");
+		}
+
+		//The superclass stays in a local named super that the methods capture
+		beginScope();
+		Token super = syntheticToken("super");
+		addLocal(&super);
+		defineVariable(0);
+
+		namedVariable(&className, false);
+		emitByte(OP_INHERIT);
+		classCompiler.hasSuperclass = true;
+	}
 
 	namedVariable(&className, false);
 	consume(TOKEN_LEFT_BRACE, "Expect '{' before class body.");
@@ -587,8 +915,54 @@ static void classDeclaration() {
 	}
 	consume(TOKEN_RIGHT_BRACE, "Expect '}' after class body.");
 	emitByte(OP_POP);
+
+	if (classCompiler.hasSuperclass) {
+		endScope();
+	}
+	currentClass = currentClass->enclosing;
 }
 
+
+//struct Name { a, b }. The layout is known here, so the type is a constant of the chunk.
+static void structDeclaration() {
+	consume(TOKEN_IDENTIFIER, "Expect struct name.");
+	Token structName = parser.previous;
+	declareVariable();
+
+	//Both stay on the stack until the type is in the constant array
+	ObjString* typeName = copyString(structName.lexemeStart, structName.length);
+	push(OBJ_VAL(typeName));
+	ObjStructType* type = newStructType(typeName);
+	push(OBJ_VAL(type));
+	emitBytes(OP_CONSTANT, makeConstant(OBJ_VAL(type)));
+	pop();
+	pop();
+
+	consume(TOKEN_LEFT_BRACE, "Expect '{' before struct fields.");
+	if (!check(TOKEN_RIGHT_BRACE)) {
+		do {
+			consume(TOKEN_IDENTIFIER, "Expect field name.");
+			ObjString* name = copyString(parser.previous.lexemeStart, parser.previous.length);
+			push(OBJ_VAL(name));
+			if (structFieldIndex(type, name) != -1) {
+				error("Already a field with this name in this struct.");
+			}
+			else if (type->fieldCount == UINT8_COUNT - 1) {
+				error("Can't have more than 255 fields.");
+			}
+			else {
+				Value offset;
+				bool known = tableGet(&fieldOffsets, name, &offset);
+				tableSet(&fieldOffsets, name, NUMBER_VAL(!known || AS_NUMBER(offset) == type->fieldCount ? type->fieldCount : -1));
+				addStructField(type, name);
+			}
+			pop();
+		} while (match(TOKEN_COMMA));
+	}
+	consume(TOKEN_RIGHT_BRACE, "Expect '}' after struct fields.");
+
+	defineVariable(current->scopeDepth > 0 ? 0 : globalVariable(&structName));
+}
 #pragma endregion
 
 static void printStatement() {
@@ -596,10 +970,146 @@ static void printStatement() {
 	consume(TOKEN_SEMICOLON, "Expect ';' after print statement.");
 	emitByte(OP_PRINT);
 }
+#pragma region Register backend
+//A stack operand of straight-line code: a frame slot (local or temporary) or a constant index
+typedef struct {
+	bool isConstant;
+	uint8_t index;
+} RegisterOperand;
+
+static bool isRegisterArithmetic(uint8_t instruction) {
+	return instruction == OP_ADD || instruction == OP_SUBTRACT
+		|| instruction == OP_MULTIPLY || instruction == OP_DIVIDE || instruction == OP_MOD;
+}
+
+static uint8_t registerOpcode(uint8_t instruction, bool constantOperand) {
+	switch (instruction)
+	{
+	case OP_ADD: return constantOperand ? OP_R_ADDK : OP_R_ADD;
+	case OP_SUBTRACT: return constantOperand ? OP_R_SUBTRACTK : OP_R_SUBTRACT;
+	case OP_MULTIPLY: return constantOperand ? OP_R_MULTIPLYK : OP_R_MULTIPLY;
+	case OP_DIVIDE: return constantOperand ? OP_R_DIVIDEK : OP_R_DIVIDE;
+	default: return constantOperand ? OP_R_MODK : OP_R_MOD;
+	}
+}
+
+static void emitRegisterOp(uint8_t instruction, uint8_t dst, uint8_t left, uint8_t right, int line) {
+	writeChunk(currentChunk(), instruction, line);
+	writeChunk(currentChunk(), dst, line);
+	writeChunk(currentChunk(), left, line);
+	if (instruction != OP_R_MOVE && instruction != OP_R_LOADK) {
+		writeChunk(currentChunk(), right, line);
+	}
+}
+
+//Rewrites the stack code emitted since start, if it only reads locals and constants and does
+//arithmetic on them, into three-address ops on frame slots. depth is the stack height when that
+//code starts; the value at stack position n is kept in slot depth + n.
+//With discardResult the code must end in SET_LOCAL, which the last op writes directly, and
+//nothing is left on the stack. Otherwise the result is pushed back, as the stack code would.
+static bool lowerToRegisters(int start, int depth, bool discardResult) {
+	if (!vm.registerBackend || parser.hadError) return false;
+
+	Chunk* chunk = currentChunk();
+	int end = chunk->count;
+	int height = 0;
+	int arithmetic = 0;
+	int target = -1;
+
+	for (int offset = start; offset < end; offset += instructionLength(chunk, offset)) {
+		uint8_t instruction = chunk->code[offset];
+		if (instruction == OP_GET_LOCAL || instruction == OP_CONSTANT) {
+			height++;
+		}
+		else if (isRegisterArithmetic(instruction) && height >= 2) {
+			height--;
+			arithmetic++;
+		}
+		else if (instruction == OP_SET_LOCAL && discardResult && offset + 2 == end && height == 1) {
+			target = chunk->code[offset + 1];
+		}
+		else {
+			return false;
+		}
+		if (depth + height >= UINT8_COUNT) return false;
+	}
+	if (height != 1 || (discardResult ? target == -1 : arithmetic == 0)) return false;
+
+	uint8_t code[UINT8_COUNT * 2];
+	if (end - start > (int)sizeof(code)) return false;
+	memcpy(code, chunk->code + start, end - start);
+	int line = chunk->lines[start];
+	int length = end - start;
+	chunk->count = start;
+
+	//Temporaries are numbered from depth without gaps, so every slot from depth up to the newest
+	//one holds a value written here and the VM can treat them as stack when it needs roots
+	RegisterOperand stack[UINT8_COUNT];
+	height = 0;
+	int temporaries = 0;
+	for (int offset = 0; offset < length; offset++) {
+		uint8_t instruction = code[offset];
+		if (instruction == OP_GET_LOCAL || instruction == OP_CONSTANT) {
+			stack[height].isConstant = instruction == OP_CONSTANT;
+			stack[height].index = code[++offset];
+			height++;
+			continue;
+		}
+		if (instruction == OP_SET_LOCAL) break;
+
+		RegisterOperand right = stack[--height];
+		RegisterOperand left = stack[--height];
+		bool rightTemporary = !right.isConstant && right.index >= depth;
+		if (!left.isConstant && left.index >= depth) temporaries--;
+		if (rightTemporary) temporaries--;
+		//The result takes the lowest free temporary, the last op writes the target
+		bool last = offset + 1 == length || code[offset + 1] == OP_SET_LOCAL;
+		uint8_t dst = (uint8_t)(last && target != -1 ? target : depth + temporaries);
+
+		//+ concatenates strings in order, so it only commutes with a number constant
+		bool commutative = instruction == OP_MULTIPLY
+			|| (instruction == OP_ADD && left.isConstant && IS_NUMERIC(chunk->constants.values[left.index]));
+		if (left.isConstant && !right.isConstant && commutative) {
+			RegisterOperand swap = left;
+			left = right;
+			right = swap;
+		}
+		if (left.isConstant) {
+			//Above the right operand, which may still be in the first free temporary
+			uint8_t slot = (uint8_t)(depth + temporaries + (rightTemporary ? 1 : 0));
+			emitRegisterOp(OP_R_LOADK, slot, left.index, 0, line);
+			left.isConstant = false;
+			left.index = slot;
+		}
+		emitRegisterOp(registerOpcode(instruction, right.isConstant), dst, left.index, right.index, line);
+
+		stack[height].isConstant = false;
+		stack[height].index = dst;
+		height++;
+		if (dst >= depth) temporaries++;
+	}
+
+	if (target != -1) {
+		//Plain `a = b;` or `a = 1;`
+		if (arithmetic == 0) {
+			emitRegisterOp(stack[0].isConstant ? OP_R_LOADK : OP_R_MOVE, (uint8_t)target, stack[0].index, 0, line);
+		}
+	}
+	else {
+		writeChunk(chunk, OP_GET_LOCAL, line);
+		writeChunk(chunk, (uint8_t)depth, line);
+	}
+	return true;
+}
+#pragma endregion
+
 static void expressionStatement() {
+	int start = currentChunk()->count;
 	expression();
 	consume(TOKEN_SEMICOLON, "Expect ';' after expression statement.");
-	emitByte(OP_POP);
+	if (!lowerToRegisters(start, current->localCount, true)) {
+		emitByte(OP_POP);
+	}
 }
 
 #pragma region Control flow
@@ -668,6 +1178,92 @@ static void whileStatement() {
 	emitByte(OP_POP);
 }
 
+#pragma region Counted loops
+//Operands of OP_FOR_PREP / OP_FOR_LOOP
+typedef struct {
+	uint8_t slot;
+	uint8_t limit;
+	uint8_t flags;
+	uint8_t step;
+} CountedLoop;
+
+//Recognises `i < limit` (also >, <=, >=) against a local or a constant, followed by an increment
+//of i by a number constant: `i++`, `i--`, `i += k`, `i -= k` and `i = i + k`, or their register form.
+static bool matchCountedLoop(int conditionStart, int conditionEnd, int incrementStart, int incrementEnd, CountedLoop* loop) {
+	uint8_t* code = currentChunk()->code;
+
+	int length = conditionEnd - conditionStart;
+	uint8_t* condition = code + conditionStart;
+	if (length != 5 && length != 6) return false;
+	if (condition[0] != OP_GET_LOCAL) return false;
+	if (condition[2] != OP_GET_LOCAL && condition[2] != OP_CONSTANT) return false;
+	if (condition[4] != OP_LESS && condition[4] != OP_GREATER) return false;
+	if (length == 6 && condition[5] != OP_NOT) return false;
+
+	loop->slot = condition[1];
+	loop->limit = condition[3];
+	loop->flags = 0;
+	if (condition[2] == OP_CONSTANT) loop->flags |= FOR_CONSTANT_LIMIT;
+	if (condition[4] == OP_GREATER) loop->flags |= FOR_GREATER;
+	if (length == 6) loop->flags |= FOR_NOT;
+
+	length = incrementEnd - incrementStart;
+	uint8_t* increment = code + incrementStart;
+	uint8_t op;
+	if (length == 8) {
+		if (increment[0] != OP_GET_LOCAL || increment[1] != loop->slot || increment[2] != OP_CONSTANT) return false;
+		if (increment[5] != OP_SET_LOCAL || increment[6] != loop->slot || increment[7] != OP_POP) return false;
+		op = increment[4];
+		loop->step = increment[3];
+	}
+	else if (length == 4 && increment[0] == OP_INC_LOCAL && increment[3] == OP_POP) {
+		if (increment[1] != loop->slot) return false;
+		op = OP_ADD;
+		loop->step = makeConstant(INT_VAL((int8_t)increment[2]));
+	}
+	else if (length == 5 && increment[0] == OP_CONSTANT && increment[2] == OP_ADD_SET_LOCAL && increment[4] == OP_POP) {
+		if (increment[3] != loop->slot) return false;
+		op = OP_ADD;
+		loop->step = increment[1];
+	}
+	else if (length == 4 && (increment[0] == OP_R_ADDK || increment[0] == OP_R_SUBTRACTK)) {
+		if (increment[1] != loop->slot || increment[2] != loop->slot) return false;
+		op = increment[0] == OP_R_ADDK ? OP_ADD : OP_SUBTRACT;
+		loop->step = increment[3];
+	}
+	else {
+		return false;
+	}
+	if (op != OP_ADD && op != OP_SUBTRACT) return false;
+	if (op == OP_SUBTRACT) loop->flags |= FOR_SUBTRACT;
+
+	return IS_NUMERIC(currentChunk()->constants.values[loop->step]);
+}
+
+//Returns the position of the exit jump offset
+static int emitForPrep(CountedLoop* loop) {
+	emitBytes(OP_FOR_PREP, loop->slot);
+	emitBytes(loop->limit, loop->flags);
+	emitByte(0xff);
+	emitByte(0xff);
+	return currentChunk()->count - 2;
+}
+
+static void emitForLoop(CountedLoop* loop, int bodyStart) {
+	emitBytes(OP_FOR_LOOP, loop->slot);
+	emitBytes(loop->limit, loop->flags);
+	emitByte(loop->step);
+
+	int offset = currentChunk()->count + 2 - bodyStart;
+	if (offset > UINT16_MAX) {
+		error("Loop body too large.");
+	}
+
+	emitByte((offset >> 8) & 0xff);
+	emitByte(offset & 0xff);
+}
+#pragma endregion
+
 static void forStatement() {
 	beginScope();
 	consume(TOKEN_LEFT_PAREN, "Expect '(' after for.");
@@ -684,37 +1280,55 @@ static void forStatement() {
 
 	int loopStart = currentChunk()->count;
 	int exitJump = -1;
+	int conditionEnd = -1;
 	if (!match(TOKEN_SEMICOLON)) {
 		expression();
 		consume(TOKEN_SEMICOLON, "Expect ';' after loop condition.");
 
+		conditionEnd = currentChunk()->count;
 		exitJump = emitJump(OP_JUMP_IF_FALSE);
 		emitByte(OP_POP);
 	}
 
+	CountedLoop loop;
+	bool counted = false;
 	if (!match(TOKEN_RIGHT_PAREN)) {
 		int bodyJump = emitJump(OP_JUMP);
 		int incrementStart = currentChunk()->count;
 
 		expression();
-		emitByte(OP_POP);
+		if (!lowerToRegisters(incrementStart, current->localCount, true)) {
+			emitByte(OP_POP);
+		}
 		consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
 
-		emitLoop(loopStart);
-		loopStart = incrementStart;
-		patchJump(bodyJump);
-	}
-	else
-	{
-		consume(TOKEN_RIGHT_PAREN, "Expect ')' after for clauses.");
+		counted = exitJump != -1 && !parser.hadError
+			&& matchCountedLoop(loopStart, conditionEnd, incrementStart, currentChunk()->count, &loop);
+		if (counted) {
+			//Nothing refers to the generic condition and increment yet, they are replaced outright
+			currentChunk()->count = loopStart;
+			exitJump = emitForPrep(&loop);
+			loopStart = currentChunk()->count;
+		}
+		else {
+			emitLoop(loopStart);
+			loopStart = incrementStart;
+			patchJump(bodyJump);
+		}
 	}
 
 	statement();
 
-	emitLoop(loopStart);
-	if (exitJump != -1) {
+	if (counted) {
+		emitForLoop(&loop, loopStart);
 		patchJump(exitJump);
-		emitByte(OP_POP);
+	}
+	else {
+		emitLoop(loopStart);
+		if (exitJump != -1) {
+			patchJump(exitJump);
+			emitByte(OP_POP);
+		}
 	}
 
 	endScope();
@@ -747,12 +1361,24 @@ static void declaration() {
 		functionDeclaration();
 	else if (match(TOKEN_CLASS))
 		classDeclaration();
+	else if (match(TOKEN_STRUCT))
+		structDeclaration();
 	else
 		statement();
 }
 
 static void number(bool canAssign) {
-	double value = strtod(parser.previous.lexemeStart, NULL);
+	char* start = parser.previous.lexemeStart;
+	//Literals without a fraction are ints, unless they are too big for one
+	if (memchr(start, '.', parser.previous.length) == NULL) {
+		errno = 0;
+		long long value = strtoll(start, NULL, 10);
+		if (errno == 0 && INT_FITS(value)) {
+			emitBytes(OP_CONSTANT, makeConstant(INT_VAL(value)));
+			return;
+		}
+	}
+	double value = strtod(start, NULL);
 	emitBytes(OP_CONSTANT, makeConstant(NUMBER_VAL(value)));
 }
 static void string(bool canAssign) {
@@ -790,6 +1416,34 @@ static void this_(bool canAssign) {
 	variable(false);
 }
 
+//super.name(args) calls the superclass method without binding it, super.name alone binds it
+static void super_(bool canAssign) {
+	if (currentClass == NULL) {
+		error("Can't use 'super' outside of a class.");
+	}
+	else if (!currentClass->hasSuperclass) {
+		error("Can't use 'super' in a class with no superclass.");
+	}
+
+	consume(TOKEN_DOT, "Expect '.' after 'super'.");
+	consume(TOKEN_IDENTIFIER, "Expect superclass method name.");
+	uint8_t name = identifierConstant(&parser.previous);
+
+	Token this = syntheticToken("this");
+	Token super = syntheticToken("super");
+	namedVariable(&this, false);
+	if (match(TOKEN_LEFT_PAREN)) {
+		uint8_t argCount = argumentList();
+		namedVariable(&super, false);
+		emitAccess(OP_SUPER_INVOKE, name);
+		emitByte(argCount);
+	}
+	else {
+		namedVariable(&super, false);
+		emitAccess(OP_GET_SUPER, name);
+	}
+}
+
 static void unary(bool canAssign) {
 	TokenType operatorType = parser.previous.type;
 	parsePrecedence(PREC_UNARY);
@@ -802,7 +1456,11 @@ static void unary(bool canAssign) {
 	case TOKEN_BANG:
 		emitByte(OP_NOT);
 		break;
-
+	case TOKEN_TILDE:
+		emitByte(OP_BIT_NOT);
+		break;
+	default:
+		break; //Unreachable
 	}
 
 }
@@ -826,7 +1484,14 @@ static void binary(bool canAssign) {
 	case TOKEN_STAR: emitByte(OP_MULTIPLY); break;
 	case TOKEN_SLASH: emitByte(OP_DIVIDE); break;
 	case TOKEN_PERCENT: emitByte(OP_MOD); break;
-
+	case TOKEN_TILDE_SLASH: emitByte(OP_INT_DIVIDE); break;
+
+	case TOKEN_AMPERSAND: emitByte(OP_BIT_AND); break;
+	case TOKEN_PIPE: emitByte(OP_BIT_OR); break;
+	case TOKEN_CARET: emitByte(OP_BIT_XOR); break;
+	case TOKEN_LESS_LESS: emitByte(OP_SHIFT_LEFT); break;
+	case TOKEN_GREATER_GREATER: emitByte(OP_SHIFT_RIGHT); break;
+	default: break; //Unreachable
 	}
 }
 
@@ -836,7 +1501,7 @@ static void literal(bool canAssign) {
 	case TOKEN_NIL:		emitByte(OP_NIL); break;
 	case TOKEN_TRUE:	emitByte(OP_TRUE); break;
 	case TOKEN_FALSE:	emitByte(OP_FALSE); break;
-
+	default: break; //Unreachable
 	}
 }
 
@@ -865,6 +1530,13 @@ ParseRule rules[] = {
 [TOKEN_GREATER_EQUAL] = {NULL, binary, PREC_COMPARISON},
 [TOKEN_LESS] = {NULL, binary, PREC_COMPARISON},
 [TOKEN_LESS_EQUAL] = {NULL, binary, PREC_COMPARISON},
+[TOKEN_LESS_LESS] = {NULL, binary, PREC_SHIFT},
+[TOKEN_GREATER_GREATER] = {NULL, binary, PREC_SHIFT},
+[TOKEN_AMPERSAND] = {NULL, binary, PREC_BIT_AND},
+[TOKEN_CARET] = {NULL, binary, PREC_BIT_XOR},
+[TOKEN_PIPE] = {NULL, binary, PREC_BIT_OR},
+[TOKEN_TILDE] = {unary, NULL, PREC_NONE},
+[TOKEN_TILDE_SLASH] = {NULL, binary, PREC_FACTOR},
 
 
 [TOKEN_IDENTIFIER] = {variable, NULL, PREC_NONE},
@@ -874,6 +1546,7 @@ ParseRule rules[] = {
 
 [TOKEN_AND] = {NULL, and_, PREC_AND},
 [TOKEN_CLASS] = {NULL, NULL, PREC_NONE},
+[TOKEN_STRUCT] = {NULL, NULL, PREC_NONE},
 [TOKEN_ELSE] = {NULL, NULL, PREC_NONE},
 [TOKEN_FALSE] = {literal, NULL, PREC_NONE},
 [TOKEN_FOR] = {NULL, NULL, PREC_NONE},
@@ -885,7 +1558,7 @@ ParseRule rules[] = {
 
 [TOKEN_PRINT] = {NULL, NULL, PREC_NONE},
 [TOKEN_RETURN] = {NULL, NULL, PREC_NONE},
-[TOKEN_SUPER] = {NULL, NULL, PREC_NONE},
+[TOKEN_SUPER] = {super_, NULL, PREC_NONE},
 [TOKEN_THIS] = {this_, NULL, PREC_NONE},
 [TOKEN_TRUE] = {literal, NULL, PREC_NONE},
 [TOKEN_VAR] = {NULL, NULL, PREC_NONE},
@@ -939,7 +1612,10 @@ ObjFunction* compile(const char* source)
 	initLexer(source);
 	parser.hadError = false;
 	parser.panicMode = false;
+	parser.braceDepth = 0;
 
+	currentClass = NULL;
+	initTable(&fieldOffsets);
 	Compiler compiler;
 	initCompiler(&compiler, TYPE_SCRIPT);
 
@@ -953,6 +1629,7 @@ ObjFunction* compile(const char* source)
 	consume(TOKEN_EOF, "Expect end of expression.");
 
 	ObjFunction* function = endCompile();
+	freeTable(&fieldOffsets);
 	return parser.hadError ? NULL : function;
 }
 
@@ -965,4 +1642,5 @@ void markCompilerRoots()
 		markObj((Obj*)compiler->function);
 		compiler = compiler->enclosing;
 	}
+	markTable(&fieldOffsets);
 }
@@ -2,6 +2,19 @@
 
 #include "debug.h"
 #include "object.h"
+#include "vm.h"
+
+static int simpleInstruction(const char* name, int offset);
+static int byteInstruction(const char* name, Chunk* chunk, int offset);
+static int constantInstruction(const char* name, Chunk* chunk, int offset);
+static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset);
+static int twoByteInstruction(const char* name, Chunk* chunk, int offset);
+static int localConstantInstruction(const char* name, Chunk* chunk, int offset);
+static int registerInstruction(const char* name, bool constantOperand, Chunk* chunk, int offset);
+static int forInstruction(const char* name, Chunk* chunk, int offset);
+static int incrementInstruction(const char* name, bool constantOperand, Chunk* chunk, int offset);
+static int propertyInstruction(const char* name, Chunk* chunk, int offset);
+static int globalInstruction(const char* name, Chunk* chunk, int offset);
 
 void disassembleChunk(Chunk* chunk, const char* name)
 {
@@ -58,14 +71,28 @@ int dissassembleInstruction(Chunk* chunk, int offset)
 		return simpleInstruction("OP_DIVIDE", offset);
 	case OP_MOD:
 		return simpleInstruction("OP_MOD", offset);
+	case OP_INT_DIVIDE:
+		return simpleInstruction("OP_INT_DIVIDE", offset);
+	case OP_BIT_AND:
+		return simpleInstruction("OP_BIT_AND", offset);
+	case OP_BIT_OR:
+		return simpleInstruction("OP_BIT_OR", offset);
+	case OP_BIT_XOR:
+		return simpleInstruction("OP_BIT_XOR", offset);
+	case OP_SHIFT_LEFT:
+		return simpleInstruction("OP_SHIFT_LEFT", offset);
+	case OP_SHIFT_RIGHT:
+		return simpleInstruction("OP_SHIFT_RIGHT", offset);
+	case OP_BIT_NOT:
+		return simpleInstruction("OP_BIT_NOT", offset);
 	case OP_POP:
 		return simpleInstruction("OP_POP", offset);
 	case OP_DEFINE_GLOBAL:
-		return constantInstruction("OP_DEFINE_GLOBAL", chunk, offset);
+		return globalInstruction("OP_DEFINE_GLOBAL", chunk, offset);
 	case OP_GET_GLOBAL:
-		return constantInstruction("OP_GET_GLOBAL", chunk, offset);
+		return globalInstruction("OP_GET_GLOBAL", chunk, offset);
 	case OP_SET_GLOBAL:
-		return constantInstruction("OP_SET_GLOBAL", chunk, offset);
+		return globalInstruction("OP_SET_GLOBAL", chunk, offset);
 	case OP_GET_LOCAL:
 		return byteInstruction("OP_GET_LOCAL", chunk, offset);
 	case OP_SET_LOCAL:
@@ -79,8 +106,12 @@ int dissassembleInstruction(Chunk* chunk, int offset)
 		return jumpInstruction("OP_LOOP", -1, chunk, offset);
 	case OP_CALL:
 		return byteInstruction("OP_CALL", chunk, offset);
-	case OP_SET_DEFAULT:
-		return byteInstruction("OP_SET_DEFAULT", chunk, offset);
+	case OP_TAIL_CALL:
+		return byteInstruction("OP_TAIL_CALL", chunk, offset);
+	case OP_INVOKE:
+		return propertyInstruction("OP_INVOKE", chunk, offset);
+	case OP_TAIL_INVOKE:
+		return propertyInstruction("OP_TAIL_INVOKE", chunk, offset);
 
 	case OP_CLOSURE: {
 		offset++;
@@ -91,16 +122,20 @@ int dissassembleInstruction(Chunk* chunk, int offset)
 
 		ObjFunction* function = AS_FUNCTION(chunk->constants.values[constant]);
 		for (int j = 0;j < function->upvalueCount;j++) {
-			int isLocal = chunk->code[offset++];
+			int capture = chunk->code[offset++];
 			uint8_t index = chunk->code[offset++];
 			printf("%04d | %s %d\n",
-				offset - 2, isLocal ? "local" : "upvalue", index);
+				offset - 2, capture == CAPTURE_LOCAL ? "local" : capture == CAPTURE_LOCAL_VALUE ? "value" : "upvalue", index);
 		}
 
 		return offset;
 	}
+	case OP_CLOSURE_SHARED:
+		return constantInstruction("OP_CLOSURE_SHARED", chunk, offset);
 	case OP_GET_UPVALUE:
 		return byteInstruction("OP_GET_UPVALUE", chunk, offset);
+	case OP_GET_CAPTURED:
+		return byteInstruction("OP_GET_CAPTURED", chunk, offset);
 	case OP_SET_UPVALUE:
 		return byteInstruction("OP_SET_UPVALUE", chunk, offset);
 	case OP_CLOSE_UPVALUE:
@@ -109,18 +144,113 @@ int dissassembleInstruction(Chunk* chunk, int offset)
 	case OP_CLASS:
 		return constantInstruction("OP_CLASS", chunk, offset);
 	case OP_GET_PROPERTY:
-		return constantInstruction("OP_GET_PROPERTY", chunk, offset);
+		return propertyInstruction("OP_GET_PROPERTY", chunk, offset);
 	case OP_SET_PROPERTY:
-		return constantInstruction("OP_SET_PROPERTY", chunk, offset);
+		return propertyInstruction("OP_SET_PROPERTY", chunk, offset);
 	case OP_METHOD:
 		return constantInstruction("OP_METHOD", chunk, offset);
+	case OP_INHERIT:
+		return simpleInstruction("OP_INHERIT", offset);
+	case OP_GET_SUPER:
+		return propertyInstruction("OP_GET_SUPER", chunk, offset);
+	case OP_SUPER_INVOKE:
+		return propertyInstruction("OP_SUPER_INVOKE", chunk, offset);
+	case OP_GET_FIELD:
+		return propertyInstruction("OP_GET_FIELD", chunk, offset);
+	case OP_SET_FIELD:
+		return propertyInstruction("OP_SET_FIELD", chunk, offset);
+
+	case OP_GET_LOCAL_CONSTANT:
+		return localConstantInstruction("OP_GET_LOCAL_CONSTANT", chunk, offset);
+	case OP_GET_LOCAL_GET_LOCAL:
+		return twoByteInstruction("OP_GET_LOCAL_GET_LOCAL", chunk, offset);
+	case OP_GET_LOCAL_PROPERTY:
+		return propertyInstruction("OP_GET_LOCAL_PROPERTY", chunk, offset);
+	case OP_GET_LOCAL_FIELD:
+		return propertyInstruction("OP_GET_LOCAL_FIELD", chunk, offset);
+	case OP_SET_LOCAL_POP:
+		return byteInstruction("OP_SET_LOCAL_POP", chunk, offset);
+	case OP_JUMP_IF_FALSE_POP:
+		return jumpInstruction("OP_JUMP_IF_FALSE_POP", 1, chunk, offset);
+
+	case OP_GREATER_NUM:
+		return simpleInstruction("OP_GREATER_NUM", offset);
+	case OP_LESS_NUM:
+		return simpleInstruction("OP_LESS_NUM", offset);
+	case OP_ADD_NUM:
+		return simpleInstruction("OP_ADD_NUM", offset);
+	case OP_SUBTRACT_NUM:
+		return simpleInstruction("OP_SUBTRACT_NUM", offset);
+	case OP_MULTIPLY_NUM:
+		return simpleInstruction("OP_MULTIPLY_NUM", offset);
+	case OP_DIVIDE_NUM:
+		return simpleInstruction("OP_DIVIDE_NUM", offset);
+	case OP_GREATER_INT:
+		return simpleInstruction("OP_GREATER_INT", offset);
+	case OP_LESS_INT:
+		return simpleInstruction("OP_LESS_INT", offset);
+	case OP_ADD_INT:
+		return simpleInstruction("OP_ADD_INT", offset);
+	case OP_SUBTRACT_INT:
+		return simpleInstruction("OP_SUBTRACT_INT", offset);
+	case OP_MULTIPLY_INT:
+		return simpleInstruction("OP_MULTIPLY_INT", offset);
+
+	case OP_R_MOVE:
+		return twoByteInstruction("OP_R_MOVE", chunk, offset);
+	case OP_R_LOADK:
+		return localConstantInstruction("OP_R_LOADK", chunk, offset);
+	case OP_R_ADD:
+		return registerInstruction("OP_R_ADD", false, chunk, offset);
+	case OP_R_SUBTRACT:
+		return registerInstruction("OP_R_SUBTRACT", false, chunk, offset);
+	case OP_R_MULTIPLY:
+		return registerInstruction("OP_R_MULTIPLY", false, chunk, offset);
+	case OP_R_DIVIDE:
+		return registerInstruction("OP_R_DIVIDE", false, chunk, offset);
+	case OP_R_ADDK:
+		return registerInstruction("OP_R_ADDK", true, chunk, offset);
+	case OP_R_SUBTRACTK:
+		return registerInstruction("OP_R_SUBTRACTK", true, chunk, offset);
+	case OP_R_MULTIPLYK:
+		return registerInstruction("OP_R_MULTIPLYK", true, chunk, offset);
+	case OP_R_DIVIDEK:
+		return registerInstruction("OP_R_DIVIDEK", true, chunk, offset);
+	case OP_R_MOD:
+		return registerInstruction("OP_R_MOD", false, chunk, offset);
+	case OP_R_MODK:
+		return registerInstruction("OP_R_MODK", true, chunk, offset);
+
+	case OP_FOR_PREP:
+		return forInstruction("OP_FOR_PREP", chunk, offset);
+	case OP_FOR_LOOP:
+		return forInstruction("OP_FOR_LOOP", chunk, offset);
+
+	case OP_DUP:
+		return simpleInstruction("OP_DUP", offset);
+	case OP_INC_LOCAL:
+		return incrementInstruction("OP_INC_LOCAL", false, chunk, offset);
+	case OP_INC_UPVALUE:
+		return incrementInstruction("OP_INC_UPVALUE", false, chunk, offset);
+	case OP_INC_GLOBAL:
+		return globalInstruction("OP_INC_GLOBAL", chunk, offset);
+	case OP_INC_PROPERTY:
+		return propertyInstruction("OP_INC_PROPERTY", chunk, offset);
+	case OP_ADD_SET_LOCAL:
+		return byteInstruction("OP_ADD_SET_LOCAL", chunk, offset);
+	case OP_ADD_SET_UPVALUE:
+		return byteInstruction("OP_ADD_SET_UPVALUE", chunk, offset);
+	case OP_ADD_SET_GLOBAL:
+		return globalInstruction("OP_ADD_SET_GLOBAL", chunk, offset);
+	case OP_ADD_SET_PROPERTY:
+		return propertyInstruction("OP_ADD_SET_PROPERTY", chunk, offset);
 
 	default:
 		return offset + 1;
 	}
 }
 
-void log(const char* message)
+void logMessage(const char* message)
 {
 	printf("%s\n", message);
 }
@@ -136,7 +266,7 @@ static int byteInstruction(const char* name, Chunk* chunk, int offset) {
 	return offset + 2;
 }
 
-static constantInstruction(const char* name, Chunk* chunk, int offset) {
+static int constantInstruction(const char* name, Chunk* chunk, int offset) {
 	uint8_t constant = chunk->code[offset + 1];
 	printf("%-16s %4d '", name, constant);
 	printValue(chunk->constants.values[constant]);
@@ -145,6 +275,109 @@ static constantInstruction(const char* name, Chunk* chunk, int offset) {
 	return offset + 2;
 }
 
+static int twoByteInstruction(const char* name, Chunk* chunk, int offset) {
+	printf("%-16s %4d %4d\n", name, chunk->code[offset + 1], chunk->code[offset + 2]);
+	return offset + 3;
+}
+
+//Local slot followed by a constant index
+static int localConstantInstruction(const char* name, Chunk* chunk, int offset) {
+	uint8_t slot = chunk->code[offset + 1];
+	uint8_t constant = chunk->code[offset + 2];
+	printf("%-16s %4d %4d '", name, slot, constant);
+	printValue(chunk->constants.values[constant]);
+	printf("'\n");
+	return offset + 3;
+}
+
+//dst, left slot, then a right slot or a constant index
+static int registerInstruction(const char* name, bool constantOperand, Chunk* chunk, int offset) {
+	uint8_t right = chunk->code[offset + 3];
+	printf("%-16s %4d %4d %4d", name, chunk->code[offset + 1], chunk->code[offset + 2], right);
+	if (constantOperand) {
+		printf(" '");
+		printValue(chunk->constants.values[right]);
+		printf("'");
+	}
+	printf("\n");
+	return offset + 4;
+}
+
+//Slot or name constant, then the signed delta
+static int incrementInstruction(const char* name, bool constantOperand, Chunk* chunk, int offset) {
+	uint8_t index = chunk->code[offset + 1];
+	int8_t delta = (int8_t)chunk->code[offset + 2];
+	printf("%-16s %4d %+4d", name, index, delta);
+	if (constantOperand) {
+		printf(" '");
+		printValue(chunk->constants.values[index]);
+		printf("'");
+	}
+	printf("\n");
+	return offset + 3;
+}
+
+//[local slot,] [struct field offset,] name constant and inline cache index, then the delta for
+//OP_INC_PROPERTY or the argument count for the invokes
+static int propertyInstruction(const char* name, Chunk* chunk, int offset) {
+	uint8_t* code = chunk->code + offset;
+	int operand = 1;
+	printf("%-16s", name);
+	if (code[0] == OP_GET_LOCAL_PROPERTY || code[0] == OP_GET_LOCAL_FIELD) {
+		printf(" %4d", code[operand++]);
+	}
+	if (code[0] == OP_GET_FIELD || code[0] == OP_SET_FIELD || code[0] == OP_GET_LOCAL_FIELD) {
+		printf(" %4d", code[operand++]);
+	}
+
+	uint8_t constant = code[operand++];
+	uint16_t cache = (uint16_t)((code[operand] << 8) | code[operand + 1]);
+	operand += 2;
+	printf(" %4d '", constant);
+	printValue(chunk->constants.values[constant]);
+	printf("' #%d", cache);
+
+	if (code[0] == OP_INC_PROPERTY) {
+		printf(" %+d", (int8_t)code[operand++]);
+	}
+	else if (code[0] == OP_INVOKE || code[0] == OP_TAIL_INVOKE || code[0] == OP_SUPER_INVOKE) {
+		printf(" (%d args)", code[operand++]);
+	}
+	printf("\n");
+	return offset + operand;
+}
+
+//16 bit global slot, then the delta for OP_INC_GLOBAL
+static int globalInstruction(const char* name, Chunk* chunk, int offset) {
+	uint8_t* code = chunk->code + offset;
+	uint16_t slot = (uint16_t)((code[1] << 8) | code[2]);
+	printf("%-16s %4d", name, slot);
+	if (code[0] == OP_INC_GLOBAL) {
+		printf(" %+4d", (int8_t)code[3]);
+	}
+	printf(" '");
+	printValue(vm.globalNames.values[slot]);
+	printf("'\n");
+	return offset + (code[0] == OP_INC_GLOBAL ? 4 : 3);
+}
+
+//slot, limit, flags, the step for OP_FOR_LOOP, then the jump
+static int forInstruction(const char* name, Chunk* chunk, int offset) {
+	uint8_t* code = chunk->code + offset;
+	bool loop = code[0] == OP_FOR_LOOP;
+	int next = offset + (loop ? 7 : 6);
+	uint16_t jump = (uint16_t)((chunk->code[next - 2] << 8) | chunk->code[next - 1]);
+
+	printf("%-16s %4d %4d %4d", name, code[1], code[2], code[3]);
+	if (loop) {
+		printf(" '");
+		printValue(chunk->constants.values[code[4]]);
+		printf("'");
+	}
+	printf(" -> %d\n", loop ? next - jump : next + jump);
+	return next;
+}
+
 static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset) {
 	uint16_t jump = (uint16_t)(chunk->code[offset + 1] << 8);
 	jump |= chunk->code[offset + 2];
@@ -154,3 +387,125 @@ static int jumpInstruction(const char* name, int sign, Chunk* chunk, int offset)
 }
 
 
+
+#ifdef PROFILE_OPCODES
+#define PROFILE_OPCODE_MAX 128
+
+static const char* opcodeNames[PROFILE_OPCODE_MAX] = {
+	[OP_CONSTANT] = "CONSTANT", [OP_NIL] = "NIL", [OP_TRUE] = "TRUE", [OP_FALSE] = "FALSE",
+	[OP_EQUAL] = "EQUAL", [OP_GREATER] = "GREATER", [OP_LESS] = "LESS",
+	[OP_ADD] = "ADD", [OP_SUBTRACT] = "SUBTRACT", [OP_MULTIPLY] = "MULTIPLY", [OP_DIVIDE] = "DIVIDE",
+	[OP_MOD] = "MOD", [OP_NOT] = "NOT", [OP_NEGATE] = "NEGATE", [OP_POP] = "POP",
+	[OP_INT_DIVIDE] = "INT_DIVIDE", [OP_BIT_AND] = "BIT_AND", [OP_BIT_OR] = "BIT_OR", [OP_BIT_XOR] = "BIT_XOR",
+	[OP_SHIFT_LEFT] = "SHIFT_LEFT", [OP_SHIFT_RIGHT] = "SHIFT_RIGHT", [OP_BIT_NOT] = "BIT_NOT",
+	[OP_DEFINE_GLOBAL] = "DEFINE_GLOBAL", [OP_GET_GLOBAL] = "GET_GLOBAL", [OP_SET_GLOBAL] = "SET_GLOBAL",
+	[OP_GET_LOCAL] = "GET_LOCAL", [OP_SET_LOCAL] = "SET_LOCAL", [OP_PRINT] = "PRINT",
+	[OP_JUMP] = "JUMP", [OP_JUMP_IF_FALSE] = "JUMP_IF_FALSE", [OP_LOOP] = "LOOP",
+	[OP_CLOSURE] = "CLOSURE", [OP_CLOSURE_SHARED] = "CLOSURE_SHARED",
+	[OP_SET_UPVALUE] = "SET_UPVALUE", [OP_GET_UPVALUE] = "GET_UPVALUE", [OP_GET_CAPTURED] = "GET_CAPTURED",
+	[OP_CLOSE_UPVALUE] = "CLOSE_UPVALUE", [OP_CLASS] = "CLASS", [OP_SET_PROPERTY] = "SET_PROPERTY",
+	[OP_GET_PROPERTY] = "GET_PROPERTY", [OP_METHOD] = "METHOD",
+	[OP_INHERIT] = "INHERIT", [OP_GET_SUPER] = "GET_SUPER", [OP_SUPER_INVOKE] = "SUPER_INVOKE",
+	[OP_GET_FIELD] = "GET_FIELD", [OP_SET_FIELD] = "SET_FIELD",
+	[OP_CALL] = "CALL", [OP_TAIL_CALL] = "TAIL_CALL",
+	[OP_INVOKE] = "INVOKE", [OP_TAIL_INVOKE] = "TAIL_INVOKE", [OP_RETURN] = "RETURN",
+	[OP_GET_LOCAL_CONSTANT] = "GET_LOCAL_CONSTANT", [OP_GET_LOCAL_GET_LOCAL] = "GET_LOCAL_GET_LOCAL",
+	[OP_GET_LOCAL_PROPERTY] = "GET_LOCAL_PROPERTY", [OP_GET_LOCAL_FIELD] = "GET_LOCAL_FIELD", [OP_SET_LOCAL_POP] = "SET_LOCAL_POP",
+	[OP_JUMP_IF_FALSE_POP] = "JUMP_IF_FALSE_POP",
+	[OP_GREATER_NUM] = "GREATER_NUM", [OP_LESS_NUM] = "LESS_NUM",
+	[OP_ADD_NUM] = "ADD_NUM", [OP_SUBTRACT_NUM] = "SUBTRACT_NUM",
+	[OP_MULTIPLY_NUM] = "MULTIPLY_NUM", [OP_DIVIDE_NUM] = "DIVIDE_NUM",
+	[OP_GREATER_INT] = "GREATER_INT", [OP_LESS_INT] = "LESS_INT",
+	[OP_ADD_INT] = "ADD_INT", [OP_SUBTRACT_INT] = "SUBTRACT_INT", [OP_MULTIPLY_INT] = "MULTIPLY_INT",
+	[OP_R_MOVE] = "R_MOVE", [OP_R_LOADK] = "R_LOADK",
+	[OP_R_ADD] = "R_ADD", [OP_R_SUBTRACT] = "R_SUBTRACT", [OP_R_MULTIPLY] = "R_MULTIPLY", [OP_R_DIVIDE] = "R_DIVIDE",
+	[OP_R_ADDK] = "R_ADDK", [OP_R_SUBTRACTK] = "R_SUBTRACTK", [OP_R_MULTIPLYK] = "R_MULTIPLYK", [OP_R_DIVIDEK] = "R_DIVIDEK",
+	[OP_R_MOD] = "R_MOD", [OP_R_MODK] = "R_MODK",
+	[OP_FOR_PREP] = "FOR_PREP", [OP_FOR_LOOP] = "FOR_LOOP",
+	[OP_DUP] = "DUP",
+	[OP_INC_LOCAL] = "INC_LOCAL", [OP_INC_UPVALUE] = "INC_UPVALUE", [OP_INC_GLOBAL] = "INC_GLOBAL", [OP_INC_PROPERTY] = "INC_PROPERTY",
+	[OP_ADD_SET_LOCAL] = "ADD_SET_LOCAL", [OP_ADD_SET_UPVALUE] = "ADD_SET_UPVALUE",
+	[OP_ADD_SET_GLOBAL] = "ADD_SET_GLOBAL", [OP_ADD_SET_PROPERTY] = "ADD_SET_PROPERTY",
+};
+
+//Only instructions that sit next to each other in the chunk are counted as a sequence,
+//since those are the only ones a superinstruction can replace.
+static uint64_t dispatchCount;
+static uint64_t pairCounts[PROFILE_OPCODE_MAX][PROFILE_OPCODE_MAX];
+static uint64_t tripleCounts[PROFILE_OPCODE_MAX][PROFILE_OPCODE_MAX][PROFILE_OPCODE_MAX];
+static Chunk* lastChunk = NULL;
+static int lastOffset = -1;
+static int window[2] = { -1, -1 };
+
+void profileInstruction(Chunk* chunk, uint8_t* ip)
+{
+	int offset = (int)(ip - chunk->code);
+	uint8_t opcode = *ip;
+	dispatchCount++;
+
+	bool adjacent = chunk == lastChunk && lastOffset >= 0
+		&& offset == lastOffset + instructionLength(chunk, lastOffset);
+	if (!adjacent) {
+		window[0] = -1;
+		window[1] = -1;
+	}
+
+	if (window[1] != -1) pairCounts[window[1]][opcode]++;
+	if (window[0] != -1) tripleCounts[window[0]][window[1]][opcode]++;
+
+	window[0] = window[1];
+	window[1] = opcode;
+	lastChunk = chunk;
+	lastOffset = offset;
+}
+
+static const char* profileName(int opcode) {
+	return opcodeNames[opcode] != NULL ? opcodeNames[opcode] : "?";
+}
+
+void printOpcodeProfile()
+{
+	const int shown = 20;
+
+	fprintf(stderr, "== %llu dispatches ==\n", (unsigned long long)dispatchCount);
+	fprintf(stderr, "== opcode pairs ==\n");
+	for (int n = 0; n < shown; n++) {
+		uint64_t best = 0;
+		int bestA = 0, bestB = 0;
+		for (int a = 0; a < PROFILE_OPCODE_MAX; a++) {
+			for (int b = 0; b < PROFILE_OPCODE_MAX; b++) {
+				if (pairCounts[a][b] > best) {
+					best = pairCounts[a][b];
+					bestA = a;
+					bestB = b;
+				}
+			}
+		}
+		if (best == 0) break;
+		fprintf(stderr, "%12llu  %s %s\n", (unsigned long long)best, profileName(bestA), profileName(bestB));
+		pairCounts[bestA][bestB] = 0;
+	}
+
+	fprintf(stderr, "== opcode triples ==\n");
+	for (int n = 0; n < shown; n++) {
+		uint64_t best = 0;
+		int bestA = 0, bestB = 0, bestC = 0;
+		for (int a = 0; a < PROFILE_OPCODE_MAX; a++) {
+			for (int b = 0; b < PROFILE_OPCODE_MAX; b++) {
+				for (int c = 0; c < PROFILE_OPCODE_MAX; c++) {
+					if (tripleCounts[a][b][c] > best) {
+						best = tripleCounts[a][b][c];
+						bestA = a;
+						bestB = b;
+						bestC = c;
+					}
+				}
+			}
+		}
+		if (best == 0) break;
+		fprintf(stderr, "%12llu  %s %s %s\n", (unsigned long long)best,
+			profileName(bestA), profileName(bestB), profileName(bestC));
+		tripleCounts[bestA][bestB][bestC] = 0;
+	}
+}
+#endif // PROFILE_OPCODES
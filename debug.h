@@ -6,6 +6,11 @@
 void disassembleChunk(Chunk* chunk, const char* name);
 int dissassembleInstruction(Chunk* chunk, int offset);
 
-void log(char* message);
+void logMessage(const char* message);
+
+#ifdef PROFILE_OPCODES
+void profileInstruction(Chunk* chunk, uint8_t* ip);
+void printOpcodeProfile();
+#endif
 
 #endif debug_h
\ No newline at end of file
@@ -4,12 +4,6 @@
 #include "common.h"
 #include "lexer.h"
 
-typedef struct {
-	char* start;
-	char* current;
-	int line;
-} Lexer;
-
 Lexer lexer;
 
 static bool isAtEnd() {
@@ -160,7 +154,6 @@ static TokenType identifierType() {
 	case 'o': return checkKeyword(1, 1, "r", TOKEN_OR);
 	case 'p': return checkKeyword(1, 4, "rint", TOKEN_PRINT);
 	case 'r': return checkKeyword(1, 5, "eturn", TOKEN_RETURN);
-	case 's': return checkKeyword(1, 4, "uper", TOKEN_SUPER);
 	case 'v': return checkKeyword(1, 2, "ar", TOKEN_VAR);
 	case 'w': return checkKeyword(1, 4, "hile", TOKEN_WHILE);
 
@@ -175,6 +168,16 @@ static TokenType identifierType() {
 		}
 		break;
 
+	case 's':
+		if (lexer.current - lexer.start > 1) {
+			switch (lexer.start[1])
+			{
+			case 't': return checkKeyword(2, 4, "ruct", TOKEN_STRUCT);
+			case 'u': return checkKeyword(2, 3, "per", TOKEN_SUPER);
+			}
+		}
+		break;
+
 	case 't':
 		if (lexer.current - lexer.start > 1) {
 			switch (lexer.start[1])
@@ -206,11 +209,19 @@ void initLexer(char* source)
 	lexer.line = 1;
 }
 
+Lexer saveLexer() {
+	return lexer;
+}
+
+void restoreLexer(Lexer saved) {
+	lexer = saved;
+}
+
 Token lexToken() {
 	skipWhitespace();
 	lexer.start = lexer.current;
 	if (isAtEnd()) {
-		log("END");
+		logMessage("END");
 		return makeToken(TOKEN_EOF);
 	}
 
@@ -246,6 +257,10 @@ Token lexToken() {
 		return makeToken(match('=') ? TOKEN_STAR_EQUAL : TOKEN_STAR);
 
 	case '%': return makeToken(match('=') ? TOKEN_PERCENT_EQUAL : TOKEN_PERCENT);
+	case '&': return makeToken(TOKEN_AMPERSAND);
+	case '|': return makeToken(TOKEN_PIPE);
+	case '^': return makeToken(TOKEN_CARET);
+	case '~': return makeToken(match('/') ? TOKEN_TILDE_SLASH : TOKEN_TILDE);
 
 	//Dependant binaries
 	case '!':
@@ -256,10 +271,10 @@ Token lexToken() {
 			match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
 	case '<':
 		return makeToken(
-			match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+			match('=') ? TOKEN_LESS_EQUAL : match('<') ? TOKEN_LESS_LESS : TOKEN_LESS);
 	case '>':
 		return makeToken(
-			match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+			match('=') ? TOKEN_GREATER_EQUAL : match('>') ? TOKEN_GREATER_GREATER : TOKEN_GREATER);
 
 
 	//Long binaries
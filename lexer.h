@@ -10,17 +10,18 @@ typedef enum {
 
 	TOKEN_PERCENT, TOKEN_PLUS_PLUS,TOKEN_MINUS_MINUS, TOKEN_PLUS_EQUAL, TOKEN_MINUS_EQUAL, TOKEN_STAR_EQUAL, TOKEN_SLASH_EQUAL, 
 	TOKEN_PERCENT_EQUAL,
+	TOKEN_AMPERSAND, TOKEN_PIPE, TOKEN_CARET, TOKEN_TILDE, TOKEN_TILDE_SLASH,
 	// One or two character tokens.
 	TOKEN_BANG, TOKEN_BANG_EQUAL,
 	TOKEN_EQUAL, TOKEN_EQUAL_EQUAL,
-	TOKEN_GREATER, TOKEN_GREATER_EQUAL,
-	TOKEN_LESS, TOKEN_LESS_EQUAL,
+	TOKEN_GREATER, TOKEN_GREATER_EQUAL, TOKEN_GREATER_GREATER,
+	TOKEN_LESS, TOKEN_LESS_EQUAL, TOKEN_LESS_LESS,
 	// Literals.
 	TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER,
 	// Keywords.
 	TOKEN_AND, TOKEN_CLASS, TOKEN_ELSE, TOKEN_FALSE,
 	TOKEN_FOR, TOKEN_FUN, TOKEN_IF, TOKEN_NIL, TOKEN_OR,
-	TOKEN_PRINT, TOKEN_RETURN, TOKEN_SUPER, TOKEN_THIS,
+	TOKEN_PRINT, TOKEN_RETURN, TOKEN_STRUCT, TOKEN_SUPER, TOKEN_THIS,
 	TOKEN_TRUE, TOKEN_VAR, TOKEN_WHILE,
 	TOKEN_ERROR, TOKEN_EOF
 } TokenType;
@@ -32,8 +33,17 @@ typedef struct {
 	int line;
 }Token;
 
+typedef struct {
+	char* start;
+	char* current;
+	int line;
+} Lexer;
+
 
 void initLexer(char* source);
 Token lexToken();
+//Lookahead: save the lexer, lex on, then put it back
+Lexer saveLexer();
+void restoreLexer(Lexer saved);
 
 #endif // !lexer_h
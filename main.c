@@ -20,9 +20,13 @@
 #define MAX_INPUT_LENGTH 2000
 
 static char* readFile(const char* path) {
-	FILE* file;
-	errno_t err = fopen_s(&file, path, "rb");
-	if (err != 0 || file == NULL) {
+	FILE* file = NULL;
+#ifdef _MSC_VER
+	fopen_s(&file, path, "rb");
+#else
+	file = fopen(path, "rb");
+#endif
+	if (file == NULL) {
 		fprintf(stderr, "Error: Could not open file '%s' for reading.\n", path);
 		return NULL;
 	}
@@ -41,9 +45,31 @@ static char* readFile(const char* path) {
 
 
 int main(int argc, const char* argv[]) {
-	if (argc == 2) {
+	//Usage: Lox++ [--trace] [--register] [--max-frames count] [path]
+	const char* path = NULL;
+	bool traceExecution = false;
+	bool registerBackend = false;
+	int maxFrames = FRAMES_MAX_DEFAULT;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--trace") == 0)
+			traceExecution = true;
+		else if (strcmp(argv[i], "--register") == 0)
+			registerBackend = true;
+		else if (strcmp(argv[i], "--max-frames") == 0 && i + 1 < argc) {
+			maxFrames = atoi(argv[++i]);
+			if (maxFrames <= 0)
+				maxFrames = FRAMES_MAX_DEFAULT;
+		}
+		else
+			path = argv[i];
+	}
+
+	if (path != NULL) {
 		initVM();
-		char* buffer = readFile(argv[1]);
+		vm.traceExecution = traceExecution;
+		vm.registerBackend = registerBackend;
+		vm.maxFrames = maxFrames;
+		char* buffer = readFile(path);
 		interpret(buffer);
 	}
 	else
@@ -73,6 +99,9 @@ int main(int argc, const char* argv[]) {
 			return 1;
 		}
 		initVM();
+		vm.traceExecution = traceExecution;
+		vm.registerBackend = registerBackend;
+		vm.maxFrames = maxFrames;
 		interpret(buffer);
 	}
 
@@ -36,28 +36,29 @@ void* reallocate(void* pointer, size_t oldSize, size_t newSize)
 
 static void freeObj(Obj* object) {
 #ifdef DEBUG_LOG_GC
-	char* typeName = objTypeString(object->type);
+	char* typeName = objTypeString(objType(object));
 	printf("%p free type %s\n", (void*)object, typeName);
 #endif
 
-	switch (object->type)
+	switch (objType(object))
 	{
 	case OBJ_STRING: {
 		ObjString* string = (ObjString*)object;
-		FREE_ARRAY(char, string->chars, string->length + 1);
-		FREE(ObjString, object);
+		reallocate(object, sizeof(ObjString) + string->length + 1, 0);
 		break;
 	}
 	case OBJ_FUNCTION: {
 		ObjFunction* function = (ObjFunction*)object;
 		freeChunk(&function->chunk);
+		FREE_ARRAY(PropertyCache, function->caches, function->cacheCapacity);
+		freeValueArray(&function->defaultValues);
+		FREE_ARRAY(int, function->entries, function->entries != NULL ? function->defaults + 1 : 0);
 		FREE(ObjFunction, function);
 		break;
 	}
 	case OBJ_CLOSURE: {
 		ObjClosure* closure = (ObjClosure*)object;
-		FREE_ARRAY(ObjUpvalue*, closure->upvalues, closure->upvalueCount);
-		FREE(ObjClosure, closure);
+		reallocate(object, sizeof(ObjClosure) + sizeof(Value) * closure->upvalueCount, 0);
 		break;
 	}
 	case OBJ_UPVALUE: {
@@ -72,14 +73,35 @@ static void freeObj(Obj* object) {
 	}
 	case OBJ_INSTANCE: {
 		ObjInstance* instance = (ObjInstance*)object;
-		freeTable(&instance->fields);
+		FREE_ARRAY(Value, instance->fields, instance->fieldCapacity);
 		FREE(ObjInstance, instance);
 		break;
 	}
+	case OBJ_SHAPE: {
+		ObjShape* shape = (ObjShape*)object;
+		freeTable(&shape->transitions);
+		FREE(ObjShape, object);
+		break;
+	}
 	case OBJ_BOUND_METHOD: {
 		FREE(ObjBoundMethod, object);
 		break;
 	}
+	case OBJ_ROPE:
+		FREE(ObjRope, object);
+		break;
+	case OBJ_STRUCT_TYPE: {
+		ObjStructType* type = (ObjStructType*)object;
+		FREE_ARRAY(ObjString*, type->fieldNames, type->fieldCount);
+		FREE(ObjStructType, object);
+		break;
+	}
+	case OBJ_STRUCT: {
+		//Objects go newest first, so the older type is still there to give the size
+		ObjStruct* value = (ObjStruct*)object;
+		reallocate(object, sizeof(ObjStruct) + sizeof(Value) * value->type->fieldCount, 0);
+		break;
+	}
 	}
 
 }
@@ -88,7 +110,7 @@ void freeObjects() {
 	Obj* object = vm.objects;
 	while (object != NULL)
 	{
-		Obj* next = object->next;
+		Obj* next = objNext(object);
 		freeObj(object);
 		object = next;
 	}
@@ -102,7 +124,7 @@ void markValue(Value value)
 void markObj(Obj* obj)
 {
 	if (obj == NULL)	return;
-	if (obj->gcMarked) return;
+	if (isObjMarked(obj)) return;
 
 #ifdef DEBUG_LOG_GC
 	printf("%p mark ", (void*)obj);
@@ -110,7 +132,7 @@ void markObj(Obj* obj)
 	printf("\n");
 #endif
 
-	obj->gcMarked = true;
+	setObjMarked(obj, true);
 
 
 	if (vm.grayCapacity <= vm.grayCount) {
@@ -124,6 +146,11 @@ void markObj(Obj* obj)
 	vm.grayStack[vm.grayCount++] = obj;
 }
 
+static void markArray(ValueArray* array) {
+	for (int i = 0;i < array->count;i++) {
+		markValue(array->values[i]);
+	}
+}
 
 static void markRoots() {
 	for (Value* val = vm.stack; val < vm.stackPtr; val++) {
@@ -134,20 +161,17 @@ static void markRoots() {
 		markObj((Obj*)vm.frames[i].closure);
 	}
 
-	for (ObjUpvalue* upval = vm.openUpvalues; upval != NULL; upval = upval->next) {
-		markObj((Obj*)upval);
+	for (Value* slot = vm.stack; slot < vm.stackPtr; slot++) {
+		markObj((Obj*)vm.openUpvalues[slot - vm.stack]);
 	}
 
-	markTable(&vm.globals);
+	markTable(&vm.globalSlots);
+	markArray(&vm.globalValues);
+	markArray(&vm.globalNames);
 	markObj((Obj*)vm.initString);
 	markCompilerRoots();
 }
 
-static void markArray(ValueArray* array) {
-	for (int i = 0;i < array->count;i++) {
-		markValue(array->values[i]);
-	}
-}
 static void blackenObj(Obj* obj) {
 #ifdef DEBUG_LOG_GC
 	printf("%p blacken ", (void*)obj);
@@ -155,7 +179,7 @@ static void blackenObj(Obj* obj) {
 	printf("\n");
 #endif
 
-	switch (obj->type)
+	switch (objType(obj))
 	{
 	case OBJ_STRING:
 		break;
@@ -166,7 +190,7 @@ static void blackenObj(Obj* obj) {
 		ObjClosure* closure = (ObjClosure*)obj;
 		markObj((Obj*)closure->function);
 		for (int i = 0;i < closure->upvalueCount;i++) {
-			markObj(closure->upvalues[i]);
+			markValue(closure->upvalues[i]);
 		}
 		break;
 	}
@@ -174,18 +198,40 @@ static void blackenObj(Obj* obj) {
 		ObjFunction* function = (ObjFunction*)obj;
 		markObj((Obj*)function->name);
 		markArray(&function->chunk.constants);
+		markArray(&function->defaultValues);
+		markObj((Obj*)function->sharedClosure);
+		for (int i = 0; i < function->cacheCount; i++) {
+			for (int j = 0; j < CACHE_WAYS; j++) {
+				CacheEntry* entry = &function->caches[i].entries[j];
+				markObj((Obj*)entry->shape);
+				markObj((Obj*)entry->transition);
+				markObj((Obj*)entry->method);
+			}
+		}
 		break;
 	}
 	case OBJ_CLASS: {
 		ObjClass* klass = (ObjClass*)obj;
 		markObj(klass->name);
 		markTable(&klass->methods);
+		markObj((Obj*)klass->rootShape);
+		markObj((Obj*)klass->initializer);
 		break;
 	 }
 	case OBJ_INSTANCE: {
 		ObjInstance* instance = (ObjInstance*)obj;
 		markObj(instance->klass);
-		markTable(&instance->fields);
+		markObj((Obj*)instance->shape);
+		for (int i = 0; i < instance->shape->slotCount; i++) {
+			markValue(instance->fields[i]);
+		}
+		break;
+	}
+	case OBJ_SHAPE: {
+		ObjShape* shape = (ObjShape*)obj;
+		markObj((Obj*)shape->parent);
+		markObj((Obj*)shape->name);
+		markTable(&shape->transitions);
 		break;
 	}
 	case OBJ_BOUND_METHOD: {
@@ -194,6 +240,29 @@ static void blackenObj(Obj* obj) {
 		markValue(boundMethod->receiver);
 		break;
 	}
+	case OBJ_ROPE: {
+		ObjRope* rope = (ObjRope*)obj;
+		markObj(rope->left);
+		markObj(rope->right);
+		markObj((Obj*)rope->flat);
+		break;
+	}
+	case OBJ_STRUCT_TYPE: {
+		ObjStructType* type = (ObjStructType*)obj;
+		markObj((Obj*)type->name);
+		for (int i = 0; i < type->fieldCount; i++) {
+			markObj((Obj*)type->fieldNames[i]);
+		}
+		break;
+	}
+	case OBJ_STRUCT: {
+		ObjStruct* value = (ObjStruct*)obj;
+		markObj((Obj*)value->type);
+		for (int i = 0; i < value->type->fieldCount; i++) {
+			markValue(value->fields[i]);
+		}
+		break;
+	}
 	}
 }
 
@@ -210,21 +279,21 @@ static void sweep() {
 	Obj* object = vm.objects;
 	while (object != NULL)
 	{
-		if (object->gcMarked) {
-			object->gcMarked = false;
+		if (isObjMarked(object)) {
+			setObjMarked(object, false);
 			previous = object;
-			object = object->next;
+			object = objNext(object);
 		}
 		else {
 			Obj* unreachable = object;
-			object = object->next;
+			object = objNext(object);
 			if (previous != NULL) {
-				previous->next = object;
+				setObjNext(previous, object);
 			}
 			else {
 				vm.objects = object;
 			}
-			if (unreachable->type == OBJ_STRING) {
+			if (objType(unreachable) == OBJ_STRING) {
 				ObjString* string = (ObjString*)unreachable;
 			}
 			freeObj(unreachable);
@@ -5,7 +5,7 @@
 #include "object.h"
 
 #define ALLOCATE(type, count) \
-			(type*)reallocate(NULL, 0, sizeof(type) * count)
+			(type*)reallocate(NULL, 0, sizeof(type) * (count))
 
 #define GROW_CAPACITY(capacity) \
 		((capacity) < 8 ? 8 : 2 * (capacity))
@@ -12,13 +12,11 @@
 			(type*)allocateObj(sizeof(type), objectType)
 
 
-static Obj* allocateObj(size_t size, ObjType type) {
-	Obj* object = reallocate(NULL, 0, size);
-	object->type = type;
-
-	object->gcMarked = false;
-
-	object->next = vm.objects;
+//Fills in the header of a block from reallocate and links it into vm.objects
+static Obj* initObj(Obj* object, size_t size, ObjType type) {
+	//Unmarked
+	object->header = (uint64_t)type << OBJ_TYPE_SHIFT;
+	setObjNext(object, vm.objects);
 	vm.objects = object;
 
 #ifdef DEBUG_LOG_GC
@@ -28,11 +26,20 @@ static Obj* allocateObj(size_t size, ObjType type) {
 
 	return object;
 }
+static Obj* allocateObj(size_t size, ObjType type) {
+	return initObj(reallocate(NULL, 0, size), size, type);
+}
 
-static ObjString* allocateString(char* chars, int length, uint32_t hash) {
-	ObjString* string = ALLOCATE_OBJ(ObjString, OBJ_STRING);
-	string->chars = chars;
+ObjString* allocateString(int length)
+{
+	ObjString* string = reallocate(NULL, 0, sizeof(ObjString) + length + 1);
 	string->length = length;
+	string->chars[length] = '\0';
+	return string;
+}
+
+static ObjString* internString(ObjString* string, uint32_t hash) {
+	initObj((Obj*)string, sizeof(ObjString) + string->length + 1, OBJ_STRING);
 	string->hash = hash;
 
 	push(OBJ_VAL(string));
@@ -61,19 +68,23 @@ char* objTypeString(ObjType type)
 	case OBJ_INSTANCE: return "OBJ_INSTANCE";
 	case OBJ_STRING: return "OBJ_STRING";
 	case OBJ_UPVALUE: return "OBJ_UPVALUE";
+	case OBJ_SHAPE: return "OBJ_SHAPE";
+	case OBJ_STRUCT_TYPE: return "OBJ_STRUCT_TYPE";
+	case OBJ_STRUCT: return "OBJ_STRUCT";
+	case OBJ_ROPE: return "OBJ_ROPE";
 	}
 	return "UNKOWN_OBJ_TYPE";
 }
 
-ObjString* takeString(char* chars, int length)
+ObjString* takeString(ObjString* string)
 {
-	uint32_t hash = hashString(chars, length);
-	ObjString* intern = findTableString(&vm.internStrings, chars, length, hash);
+	uint32_t hash = hashString(string->chars, string->length);
+	ObjString* intern = findTableString(&vm.internStrings, string->chars, string->length, hash);
 	if (intern != NULL) {
-		FREE_ARRAY(char, chars, length);
+		reallocate(string, sizeof(ObjString) + string->length + 1, 0);
 		return intern;
 	}
-	return allocateString(chars, length, hash);
+	return internString(string, hash);
 }
 
 ObjString* copyString(const char* chars, int length)
@@ -82,18 +93,65 @@ ObjString* copyString(const char* chars, int length)
 	ObjString* intern = findTableString(&vm.internStrings, chars, length, hash);
 	if (intern != NULL) return intern;
 
-	char* heapString = ALLOCATE(char, length + 1);
-	memcpy(heapString, chars, length);
-	heapString[length] = '\0';
+	ObjString* string = allocateString(length);
+	memcpy(string->chars, chars, length);
+	return internString(string, hash);
+}
 
-	return allocateString(heapString, length, hash);
+ObjRope* newRope(Obj* left, Obj* right)
+{
+	ObjRope* rope = ALLOCATE_OBJ(ObjRope, OBJ_ROPE);
+	rope->length = textLength(left) + textLength(right);
+	rope->left = left;
+	rope->right = right;
+	rope->flat = NULL;
+	return rope;
+}
+
+ObjString* flattenString(Obj* text)
+{
+	if (objType(text) == OBJ_STRING) return (ObjString*)text;
+	ObjRope* rope = (ObjRope*)text;
+	if (rope->flat != NULL) return rope->flat;
+
+	ObjString* string = allocateString(rope->length);
+	int written = 0;
+
+	//Pieces left to copy, the next one on top. A string built up in a loop is one long chain of
+	//ropes, too deep to recurse down.
+	int capacity = 8;
+	int count = 0;
+	Obj** pending = ALLOCATE(Obj*, capacity);
+	pending[count++] = text;
+	while (count > 0) {
+		Obj* node = pending[--count];
+		if (objType(node) == OBJ_ROPE && ((ObjRope*)node)->flat == NULL) {
+			if (count + 2 > capacity) {
+				int oldCapacity = capacity;
+				capacity = GROW_CAPACITY(oldCapacity);
+				pending = GROW_ARRAY(Obj*, pending, oldCapacity, capacity);
+			}
+			pending[count++] = ((ObjRope*)node)->right;
+			pending[count++] = ((ObjRope*)node)->left;
+		}
+		else {
+			ObjString* piece = flattenString(node);
+			memcpy(string->chars + written, piece->chars, piece->length);
+			written += piece->length;
+		}
+	}
+	FREE_ARRAY(Obj*, pending, capacity);
+
+	rope->flat = takeString(string);
+	rope->left = NULL;
+	rope->right = NULL;
+	return rope->flat;
 }
 
 ObjUpvalue* newUpvalue(Value* slot)
 {
 	ObjUpvalue* upvalue = ALLOCATE_OBJ(ObjUpvalue, OBJ_UPVALUE);
 	upvalue->location = slot;
-	upvalue->next = NULL;
 	upvalue->closed = NIL_VAL;
 	return upvalue;
 }
@@ -103,22 +161,25 @@ ObjFunction* newFunction()
 	ObjFunction* function = ALLOCATE_OBJ(ObjFunction, OBJ_FUNCTION);
 	function->arity = 0;
 	function->defaults = 0;
+	initValueArray(&function->defaultValues);
+	function->entries = NULL;
 	function->upvalueCount = 0;
 	function->name = NULL;
+	function->caches = NULL;
+	function->cacheCount = 0;
+	function->cacheCapacity = 0;
+	function->sharedClosure = NULL;
 	initChunk(&function->chunk);
 	return function;
 }
 
 ObjClosure* newClosure(ObjFunction* function)
 {
-	ObjClosure* closure = ALLOCATE_OBJ(ObjClosure, OBJ_CLOSURE);
+	ObjClosure* closure = (ObjClosure*)allocateObj(sizeof(ObjClosure) + sizeof(Value) * function->upvalueCount, OBJ_CLOSURE);
 	closure->function = function;
-
-	ObjUpvalue** upvalues = ALLOCATE(ObjUpvalue*, function->upvalueCount);
 	for (int i = 0;i < function->upvalueCount;i++) {
-		upvalues[i] = NULL;
+		closure->upvalues[i] = NIL_VAL;
 	}
-	closure->upvalues = upvalues;
 	closure->upvalueCount = function->upvalueCount;
 	return closure;
 }
@@ -128,7 +189,15 @@ ObjClass* newClass(ObjString* name)
 	ObjClass* klass = ALLOCATE_OBJ(ObjClass, OBJ_CLASS);
 	klass->name = name;
 	klass->arity = 0;
+	klass->methodVersion = 0;
+	klass->rootShape = NULL;
+	klass->initializer = NULL;
+	klass->fieldHint = 0;
 	initTable(&klass->methods);
+
+	push(OBJ_VAL(klass));
+	klass->rootShape = newShape(NULL, NULL);
+	pop();
 	return klass;
 }
 
@@ -136,7 +205,16 @@ ObjInstance* newInstance(ObjClass* klass)
 {
 	ObjInstance* instance = ALLOCATE_OBJ(ObjInstance, OBJ_INSTANCE);
 	instance->klass = klass;
-	initTable(&instance->fields);
+	instance->shape = klass->rootShape;
+	instance->fields = NULL;
+	instance->fieldCapacity = 0;
+
+	if (klass->fieldHint > 0) {
+		push(OBJ_VAL(instance));
+		instance->fields = ALLOCATE(Value, klass->fieldHint);
+		instance->fieldCapacity = klass->fieldHint;
+		pop();
+	}
 	return instance;
 }
 
@@ -148,6 +226,105 @@ ObjBoundMethod* newBoundMethod(Value receiver, ObjClosure* closure)
 	return boundMethod;
 }
 
+#pragma region Shapes
+ObjShape* newShape(ObjShape* parent, ObjString* name)
+{
+	ObjShape* shape = ALLOCATE_OBJ(ObjShape, OBJ_SHAPE);
+	shape->parent = parent;
+	shape->name = name;
+	shape->slotCount = parent != NULL ? parent->slotCount + 1 : 0;
+	initTable(&shape->transitions);
+
+	push(OBJ_VAL(shape));
+	if (parent != NULL) {
+		tableSet(&parent->transitions, name, OBJ_VAL(shape));
+	}
+	pop();
+	return shape;
+}
+
+//Slot index of the field in the shape, -1 if the shape doesn't have it. Walks the chain, but only
+//cache misses get here.
+int shapeSlot(ObjShape* shape, ObjString* name)
+{
+	for (; shape->parent != NULL; shape = shape->parent) {
+		if (shape->name == name) return shape->slotCount - 1;
+	}
+	return -1;
+}
+
+//Shape reached by adding the field, shared with every other instance that added it here
+ObjShape* shapeTransition(ObjShape* shape, ObjString* name)
+{
+	Value child;
+	if (tableGet(&shape->transitions, name, &child)) return AS_SHAPE(child);
+	return newShape(shape, name);
+}
+
+//Makes room for count fields before the instance moves to a bigger shape
+void reserveFields(ObjInstance* instance, int count)
+{
+	if (count > instance->klass->fieldHint) {
+		instance->klass->fieldHint = count;
+	}
+	if (count <= instance->fieldCapacity) return;
+
+	int oldCapacity = instance->fieldCapacity;
+	instance->fieldCapacity = oldCapacity < 4 ? 4 : oldCapacity * 2;
+	if (instance->fieldCapacity < count) instance->fieldCapacity = count;
+	instance->fields = GROW_ARRAY(Value, instance->fields, oldCapacity, instance->fieldCapacity);
+}
+#pragma endregion
+
+#pragma region Structs
+ObjStructType* newStructType(ObjString* name)
+{
+	ObjStructType* type = ALLOCATE_OBJ(ObjStructType, OBJ_STRUCT_TYPE);
+	type->name = name;
+	type->fieldNames = NULL;
+	type->fieldCount = 0;
+	return type;
+}
+
+void addStructField(ObjStructType* type, ObjString* name)
+{
+	type->fieldNames = GROW_ARRAY(ObjString*, type->fieldNames, type->fieldCount, type->fieldCount + 1);
+	type->fieldNames[type->fieldCount++] = name;
+}
+
+//Index of the field in the layout, -1 if the type doesn't have it
+int structFieldIndex(ObjStructType* type, ObjString* name)
+{
+	for (int i = 0; i < type->fieldCount; i++) {
+		if (type->fieldNames[i] == name) return i;
+	}
+	return -1;
+}
+
+//The fields are left for the caller to fill
+ObjStruct* newStruct(ObjStructType* type)
+{
+	ObjStruct* value = (ObjStruct*)allocateObj(sizeof(ObjStruct) + sizeof(Value) * type->fieldCount, OBJ_STRUCT);
+	value->type = type;
+	return value;
+}
+
+//Nested structs are not expanded, a struct may well contain itself
+static void printStruct(ObjStruct* value) {
+	printf("%s(", value->type->name->chars);
+	for (int i = 0; i < value->type->fieldCount; i++) {
+		if (i > 0) printf(", ");
+		if (IS_STRUCT(value->fields[i])) {
+			printf("%s(...)", AS_STRUCT(value->fields[i])->type->name->chars);
+		}
+		else {
+			printValue(value->fields[i]);
+		}
+	}
+	printf(")");
+}
+#pragma endregion
+
 static void printFunction(ObjFunction* function) {
 	if (function->name == NULL)
 		printf("<script>");
@@ -162,6 +339,9 @@ void printObj(Value value)
 	case OBJ_STRING:
 		printf("%s", AS_CSTRING(value));
 		break;
+	case OBJ_ROPE:
+		printf("%s", flattenString(AS_OBJ(value))->chars);
+		break;
 
 	case OBJ_FUNCTION:
 		printFunction(AS_FUNCTION(value));
@@ -182,7 +362,19 @@ void printObj(Value value)
 		break;
 	}
 	case OBJ_BOUND_METHOD: {
-		printFunction(AS_BOUND_METHOD(value)->method);
+		printFunction(AS_BOUND_METHOD(value)->method->function);
+		break;
+	}
+	case OBJ_SHAPE: {
+		printf("shape");
+		break;
+	}
+	case OBJ_STRUCT_TYPE: {
+		printf("%s", AS_STRUCT_TYPE(value)->name->chars);
+		break;
+	}
+	case OBJ_STRUCT: {
+		printStruct(AS_STRUCT(value));
 		break;
 	}
 	default:
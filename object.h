@@ -7,12 +7,17 @@
 #include "table.h"
 
 
-#define OBJ_TYPE(value) (AS_OBJ(value)->type)
+#define OBJ_TYPE(value) objType(AS_OBJ(value))
 
 #define IS_STRING(value) isObjType(value, OBJ_STRING)
 #define AS_STRING(value) ((ObjString*)AS_OBJ(value))
 #define AS_CSTRING(value) (((ObjString*)AS_OBJ(value))->chars)
 
+#define IS_ROPE(value) isObjType(value, OBJ_ROPE)
+#define AS_ROPE(value) ((ObjRope*)AS_OBJ(value))
+//Either kind of string, as + and == take them
+#define IS_STRING_OR_ROPE(value) (IS_STRING(value) || IS_ROPE(value))
+
 #define IS_UPVALUE(value) isObjType(value, OBJ_UPVALUE)
 #define AS_UPVALUE(value) ((ObjUpvalue*)AS_OBJ(value))
 
@@ -31,6 +36,15 @@
 #define IS_BOUND_METHOD(value) isObjType(value, OBJ_BOUND_METHOD)
 #define AS_BOUND_METHOD(value) ((ObjBoundMethod*)AS_OBJ(value))
 
+#define IS_SHAPE(value) isObjType(value, OBJ_SHAPE)
+#define AS_SHAPE(value) ((ObjShape*)AS_OBJ(value))
+
+#define IS_STRUCT_TYPE(value) isObjType(value, OBJ_STRUCT_TYPE)
+#define AS_STRUCT_TYPE(value) ((ObjStructType*)AS_OBJ(value))
+
+#define IS_STRUCT(value) isObjType(value, OBJ_STRUCT)
+#define AS_STRUCT(value) ((ObjStruct*)AS_OBJ(value))
+
 
 typedef enum {
 	OBJ_STRING,
@@ -40,68 +54,148 @@ typedef enum {
 	OBJ_CLASS,
 	OBJ_INSTANCE,
 	OBJ_BOUND_METHOD,
+	OBJ_SHAPE,
+	OBJ_STRUCT_TYPE,
+	OBJ_STRUCT,
+	OBJ_ROPE,
 } ObjType;
 
 char* objTypeString(ObjType type);
 
+//The whole header is one word: the next object of vm.objects in the low 48 bits (where user space
+//pointers fit, as NaN boxing already assumes), the GC mark in bit 48 and the ObjType in the top byte.
+//Bits 49 to 55 are free.
 struct Obj
 {
-	ObjType type;
-
-	bool gcMarked;
-	//NURN sintaxe
-	struct Obj* next;
+	uint64_t header;
 };
 
+#define OBJ_NEXT_MASK ((uint64_t)0x0000ffffffffffff)
+#define OBJ_MARK_BIT ((uint64_t)1 << 48)
+#define OBJ_TYPE_SHIFT 56
+
+static inline ObjType objType(Obj* object) {
+	return (ObjType)(object->header >> OBJ_TYPE_SHIFT);
+}
+static inline Obj* objNext(Obj* object) {
+	return (Obj*)(uintptr_t)(object->header & OBJ_NEXT_MASK);
+}
+static inline void setObjNext(Obj* object, Obj* next) {
+	object->header = (object->header & ~OBJ_NEXT_MASK) | (uint64_t)(uintptr_t)next;
+}
+static inline bool isObjMarked(Obj* object) {
+	return (object->header & OBJ_MARK_BIT) != 0;
+}
+static inline void setObjMarked(Obj* object, bool marked) {
+	object->header = marked ? object->header | OBJ_MARK_BIT : object->header & ~OBJ_MARK_BIT;
+}
+
+//One block: the characters, NUL terminated, right after the header
 struct ObjString
 {
 	Obj obj;
 	int length;
-	char* chars;
-
 	uint32_t hash;
+
+	char chars[];
 };
 
 typedef struct {
 	Obj obj;
 	Value* location;
 	Value closed;
-
-	struct ObjUpvalue* next;
 } ObjUpvalue;
 
 typedef struct{
 	Obj obj;
 	int arity;
 	int defaults;
+	//Value of each default parameter, nil for the ones computed by code at the start of the body
+	ValueArray defaultValues;
+	//Offset to start running at for each number of defaults the caller gave (defaults + 1 of them)
+	int* entries;
 
 	int upvalueCount;
 
 	Chunk chunk;
 	ObjString* name;
+
+	//Inline caches of the property instructions, indexed by their cache operand
+	struct PropertyCache* caches;
+	int cacheCount;
+	int cacheCapacity;
+
+	//The one closure OP_CLOSURE_SHARED hands out for a function that captures nothing
+	struct ObjClosure* sharedClosure;
 } ObjFunction;
 
-typedef struct {
+typedef struct ObjClosure {
 	Obj obj;
 	ObjFunction* function;
 
-	ObjUpvalue** upvalues;
 	int upvalueCount;
+	//An ObjUpvalue for a captured variable that is reassigned, a copy of the value for one that is not
+	Value upvalues[];
 } ObjClosure;
 
 
+//Hidden class: the field layout shared by every instance that got the same fields in the same order.
+//Shapes form a tree per class, adding a field moves an instance to a child shape. Each shape only
+//knows its own field, the slot of any other is found up the parent chain.
+typedef struct ObjShape {
+	Obj obj;
+	struct ObjShape* parent;
+	//Field added by this shape, NULL for the root
+	ObjString* name;
+	int slotCount;
+
+	//Field name -> child shape
+	Table transitions;
+} ObjShape;
+
+//What a property instruction resolved for instances of one shape
+typedef struct {
+	ObjShape* shape;
+	//Shape after OP_SET_PROPERTY adds the field, NULL when the field already exists
+	ObjShape* transition;
+	//Field slot, -1 when the property is a method
+	int slot;
+	ObjClosure* method;
+	//methodVersion of the class when the method was looked up
+	int methodVersion;
+} CacheEntry;
+
+#define CACHE_WAYS 4
+
+typedef struct PropertyCache {
+	CacheEntry entries[CACHE_WAYS];
+	//Entry replaced next once all of them are taken
+	int nextEvict;
+} PropertyCache;
+
 typedef struct {
 	Obj obj;
 	ObjString* name;
 	int arity;
 
 	Table methods;
+	//Bumped whenever methods changes, so cached lookups in it can be told stale
+	int methodVersion;
+	//Shape of instances without fields
+	ObjShape* rootShape;
+	//init, NULL when the class has none
+	ObjClosure* initializer;
+	//Most fields an instance has reached, new instances start with room for them
+	int fieldHint;
 } ObjClass;
 
 typedef struct {
 	Obj obj;
 	ObjClass* klass;
-	Table fields;
+	ObjShape* shape;
+	//Field values, indexed by the slots of the shape
+	Value* fields;
+	int fieldCapacity;
 } ObjInstance;
 
 typedef struct {
@@ -110,13 +204,53 @@ typedef struct {
 	ObjClosure* method;
 } ObjBoundMethod;
 
+//Field layout of a struct declaration, fixed when it is compiled
+typedef struct {
+	Obj obj;
+	ObjString* name;
+	//Field i of every value of the type is fields[i]
+	ObjString** fieldNames;
+	int fieldCount;
+} ObjStructType;
+
+//A concatenation not built yet. The first time its characters or identity are needed it is
+//flattened into an interned ObjString, kept in flat, and lets go of its halves.
+typedef struct {
+	Obj obj;
+	int length;
+	//An ObjString or ObjRope each
+	Obj* left;
+	Obj* right;
+	ObjString* flat;
+} ObjRope;
+
+//Shorter concatenations are built right away, so both halves of a rope are never both short
+#define ROPE_MIN_LENGTH 64
+
+//Value of a struct type: one block, the fields right after the header
+typedef struct {
+	Obj obj;
+	ObjStructType* type;
+	Value fields[];
+} ObjStruct;
+
 static inline bool isObjType(Value value, ObjType type) {
-	return IS_OBJ(value) && AS_OBJ(value)->type == type;
+	return IS_OBJ(value) && objType(AS_OBJ(value)) == type;
 }
 
-ObjString* takeString(char* chars, int length);
+//A string to fill in: chars holds length characters plus the terminator. It is not an object yet,
+//takeString interns it (or frees it in favour of an equal string already interned).
+ObjString* allocateString(int length);
+ObjString* takeString(ObjString* string);
 ObjString* copyString(const char* chars, int length);
 
+ObjRope* newRope(Obj* left, Obj* right);
+//The interned string with the characters of a string or rope
+ObjString* flattenString(Obj* text);
+static inline int textLength(Obj* text) {
+	return objType(text) == OBJ_STRING ? ((ObjString*)text)->length : ((ObjRope*)text)->length;
+}
+
 ObjUpvalue* newUpvalue(Value* slot);
 
 ObjFunction* newFunction();
@@ -129,6 +263,17 @@ ObjInstance* newInstance(ObjClass* klass);
 
 ObjBoundMethod* newBoundMethod(Value receiver, ObjClosure* closure);
 
+ObjShape* newShape(ObjShape* parent, ObjString* name);
+int shapeSlot(ObjShape* shape, ObjString* name);
+ObjShape* shapeTransition(ObjShape* shape, ObjString* name);
+
+void reserveFields(ObjInstance* instance, int count);
+
+ObjStructType* newStructType(ObjString* name);
+void addStructField(ObjStructType* type, ObjString* name);
+int structFieldIndex(ObjStructType* type, ObjString* name);
+ObjStruct* newStruct(ObjStructType* type);
+
 void printObj(Value value);
 
 #endif // !object_h
@@ -0,0 +1,139 @@
+#include <stdlib.h>
+
+#include "optimizer.h"
+#include "memory.h"
+
+static bool isJump(uint8_t instruction) {
+	return instruction == OP_JUMP || instruction == OP_JUMP_IF_FALSE
+		|| instruction == OP_JUMP_IF_FALSE_POP || instruction == OP_LOOP
+		|| instruction == OP_FOR_PREP || instruction == OP_FOR_LOOP;
+}
+
+static bool isBackwardJump(uint8_t instruction) {
+	return instruction == OP_LOOP || instruction == OP_FOR_LOOP;
+}
+
+//Every jump keeps its 16 bit offset in its last two bytes, relative to the next instruction
+static int jumpTarget(Chunk* chunk, int offset) {
+	int next = offset + instructionLength(chunk, offset);
+	uint16_t jump = (uint16_t)((chunk->code[next - 2] << 8) | chunk->code[next - 1]);
+	if (isBackwardJump(chunk->code[offset])) return next - jump;
+	return next + jump;
+}
+
+static void emit(Chunk* chunk, Chunk* from, int offset, int length, uint8_t opcode) {
+	writeChunk(chunk, opcode, from->lines[offset]);
+	for (int i = 1; i < length; i++) {
+		writeChunk(chunk, from->code[offset + i], from->lines[offset]);
+	}
+}
+
+//Superinstructions picked from the PROFILE_OPCODES histogram of the bench/ scripts.
+//Returns the fused opcode for the pair at offset and next, or -1 when it stays as it is.
+static int fusePair(Chunk* chunk, int offset, int next) {
+	uint8_t first = chunk->code[offset];
+	uint8_t second = chunk->code[next];
+
+	switch (first)
+	{
+	case OP_GET_LOCAL:
+		if (second == OP_CONSTANT) return OP_GET_LOCAL_CONSTANT;
+		if (second == OP_GET_LOCAL) return OP_GET_LOCAL_GET_LOCAL;
+		if (second == OP_GET_PROPERTY) return OP_GET_LOCAL_PROPERTY;
+		if (second == OP_GET_FIELD) return OP_GET_LOCAL_FIELD;
+		return -1;
+	case OP_SET_LOCAL:
+		if (second == OP_POP) return OP_SET_LOCAL_POP;
+		return -1;
+	case OP_JUMP_IF_FALSE:
+		//Both ways out of the jump must start with a pop for the pop to be folded into it
+		if (second == OP_POP && chunk->code[jumpTarget(chunk, offset)] == OP_POP) return OP_JUMP_IF_FALSE_POP;
+		return -1;
+	default:
+		return -1;
+	}
+}
+
+void optimizeFunction(ObjFunction* function)
+{
+	Chunk* chunk = &function->chunk;
+
+	//Jumping into the middle of a superinstruction is impossible, so jump targets are never fused.
+	bool* isTarget = calloc(chunk->count + 1, sizeof(bool));
+	int* newOffsets = malloc(sizeof(int) * (chunk->count + 1));
+	if (isTarget == NULL || newOffsets == NULL) exit(1);
+
+	for (int offset = 0; offset < chunk->count; offset += instructionLength(chunk, offset)) {
+		if (isJump(chunk->code[offset])) {
+			isTarget[jumpTarget(chunk, offset)] = true;
+		}
+	}
+	//Calls that skip defaults start in the middle, just like a jump lands there
+	for (int i = 0; function->entries != NULL && i <= function->defaults; i++) {
+		isTarget[function->entries[i]] = true;
+	}
+
+	Chunk optimized;
+	initChunk(&optimized);
+
+	int offset = 0;
+	while (offset < chunk->count) {
+		int length = instructionLength(chunk, offset);
+		int next = offset + length;
+		newOffsets[offset] = optimized.count;
+
+		int fused = next < chunk->count && !isTarget[next] ? fusePair(chunk, offset, next) : -1;
+		if (fused == -1) {
+			emit(&optimized, chunk, offset, length, chunk->code[offset]);
+			offset = next;
+			continue;
+		}
+
+		int nextLength = instructionLength(chunk, next);
+		newOffsets[next] = optimized.count;
+		//Operands of both instructions, back to back. Jumps are re-encoded below.
+		emit(&optimized, chunk, offset, length, (uint8_t)fused);
+		if (fused != OP_JUMP_IF_FALSE_POP) {
+			for (int i = 1; i < nextLength; i++) {
+				writeChunk(&optimized, chunk->code[next + i], chunk->lines[offset]);
+			}
+		}
+		offset = next + nextLength;
+	}
+	newOffsets[chunk->count] = optimized.count;
+
+	//Re-encode jumps against the new layout
+	for (int old = 0; old < chunk->count; old += instructionLength(chunk, old)) {
+		if (!isJump(chunk->code[old])) continue;
+
+		int newOffset = newOffsets[old];
+		uint8_t instruction = optimized.code[newOffset];
+		int target = jumpTarget(chunk, old);
+		if (instruction == OP_JUMP_IF_FALSE_POP && chunk->code[old] == OP_JUMP_IF_FALSE) {
+			//Land after the pop at the target, the fused instruction already popped
+			target++;
+		}
+
+		int next = newOffset + instructionLength(&optimized, newOffset);
+		int jump = isBackwardJump(instruction)
+			? next - newOffsets[target]
+			: newOffsets[target] - next;
+		optimized.code[next - 2] = (uint8_t)((jump >> 8) & 0xff);
+		optimized.code[next - 1] = (uint8_t)(jump & 0xff);
+	}
+
+	for (int i = 0; function->entries != NULL && i <= function->defaults; i++) {
+		function->entries[i] = newOffsets[function->entries[i]];
+	}
+
+	free(isTarget);
+	free(newOffsets);
+
+	FREE_ARRAY(uint8_t, chunk->code, chunk->capacity);
+	FREE_ARRAY(int, chunk->lines, chunk->capacity);
+	chunk->code = optimized.code;
+	chunk->lines = optimized.lines;
+	chunk->count = optimized.count;
+	chunk->capacity = optimized.capacity;
+	freeValueArray(&optimized.constants);
+}
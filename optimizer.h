@@ -0,0 +1,11 @@
+#ifndef optimizer_h
+#define optimizer_h
+
+#include "common.h"
+#include "object.h"
+
+//Peephole pass run on every function once it is compiled.
+//Rewrites common opcode sequences into the superinstructions from chunk.h.
+void optimizeFunction(ObjFunction* function);
+
+#endif // !optimizer_h
@@ -134,7 +134,7 @@ bool tableGet(Table* table, ObjString* key, Value* outValue)
 
 void markTable(Table* table)
 {
-	for (Entry* entry = table->entries; entry < table->count; entry++) {
+	for (Entry* entry = table->entries; entry < table->entries + table->capacity; entry++) {
 		markObj(entry->key);
 		markValue(entry->value);
 	}
@@ -144,7 +144,7 @@ void tableRemoveWhite(Table* table)
 {
 	for (int i = 0;i < table->capacity;i++) {
 		Entry* entry = &table->entries[i];
-		if (entry->key != NULL && !entry->key->obj.gcMarked) {
+		if (entry->key != NULL && !isObjMarked(&entry->key->obj)) {
 			tableDelete(table, entry->key);
 		}
 	}
@@ -0,0 +1,45 @@
+#!/bin/sh
+#Builds one interpreter per variant and runs every test script on each. A script states what it
+#prints with "// expect: <line>" comments and may end with "// expect runtime error: <message>".
+#Usage: [CFLAGS=-fsanitize=address] test/run.sh
+
+cd "$(dirname "$0")/.." || exit 1
+CC=${CC:-cc}
+OUT=${TMPDIR:-/tmp}/loxtest
+mkdir -p "$OUT"
+
+#name:extra compiler flags, the builds bench/run.sh compares and one collecting on every allocation
+VARIANTS="switch:-DNO_COMPUTED_GOTO goto: nanbox:-DNAN_BOXING stress:-DDEBUG_STRESS_GC"
+#name:variant:interpreter flags. The register columns check the register backend against the stack code.
+COLUMNS="switch:switch: goto:goto: register:goto:--register nanbox:nanbox: stress:stress: stress-register:stress:--register"
+
+for variant in $VARIANTS; do
+	name=${variant%%:*}
+	flags=${variant#*:}
+	$CC -O2 -w -DNDEBUG $CFLAGS $flags *.c -o "$OUT/$name" -lm || exit 1
+done
+
+failed=0
+for column in $COLUMNS; do
+	name=${column%%:*}
+	rest=${column#*:}
+	for script in test/*.lox; do
+		expected=$(sed -n 's#.*// expect: ##p' "$script")
+		expectedError=$(sed -n 's#.*// expect runtime error: ##p' "$script")
+		#The lexer logs END once per token stream, it is not program output
+		actual=$("$OUT/${rest%%:*}" ${rest#*:} "$script" 2> "$OUT/stderr" | grep -v '^END$')
+		actualError=$(head -n 1 "$OUT/stderr")
+		if [ "$actual" != "$expected" ] || [ "$actualError" != "$expectedError" ]; then
+			echo "FAIL $name $(basename "$script" .lox)"
+			echo "  expected: $(echo $expected) $expectedError"
+			echo "  actual:   $(echo $actual) $actualError"
+			failed=$((failed + 1))
+		fi
+	done
+done
+
+if [ $failed -ne 0 ]; then
+	echo "$failed failed"
+	exit 1
+fi
+echo "All tests passed"
@@ -32,29 +32,67 @@ void freeValueArray(ValueArray* array)
 
 bool valuesEqual(Value a, Value b)
 {
-	if (a.type != b.type)	return false;
+	//A rope equals the strings with the same characters
+	if (IS_ROPE(a) || IS_ROPE(b)) {
+		return IS_STRING_OR_ROPE(a) && IS_STRING_OR_ROPE(b) && flattenString(AS_OBJ(a)) == flattenString(AS_OBJ(b));
+	}
+#ifdef NAN_BOXING
+	//Only doubles need more than comparing the bits: NaN is not equal to itself, 0 equals -0,
+	//and an int equals the double of the same value
+	if (IS_NUMBER(a) || IS_NUMBER(b)) {
+		return IS_NUMERIC(a) && IS_NUMERIC(b) && TO_NUMBER(a) == TO_NUMBER(b);
+	}
+	return a == b;
+#else
+	if (a.type != b.type) {
+		//An int equals the double of the same value
+		return IS_NUMERIC(a) && IS_NUMERIC(b) && TO_NUMBER(a) == TO_NUMBER(b);
+	}
 
 	switch (a.type)
 	{
 	case VAL_BOOL: return AS_BOOL(a) == AS_BOOL(b);
 	case VAL_NIL: return true;
 	case VAL_NUMBER: return AS_NUMBER(a) == AS_NUMBER(b);
+	case VAL_INT: return AS_INT(a) == AS_INT(b);
 
 	case VAL_OBJ:
-		switch (AS_OBJ(a)->type)
+		switch (objType(AS_OBJ(a)))
 		{
 		case OBJ_STRING: return AS_OBJ(a) == AS_OBJ(b);
 			/*ObjString* astring = AS_STRING(a);
 			ObjString* bstring = AS_STRING(b);
 			return astring->length == bstring->length
 				&& memcmp(astring->chars, bstring->chars, astring->length) == 0;*/
-		
+		default: break;
 		}
+		//Every other object is only equal to itself
+		return AS_OBJ(a) == AS_OBJ(b);
+	default: break; //VAL_UNDEFINED is never compared
 	}
+	return false;
+#endif
 }
 
 void printValue(Value value)
 {
+#ifdef NAN_BOXING
+	if (IS_NIL(value)) {
+		printf("nil");
+	}
+	else if (IS_BOOL(value)) {
+		printf(AS_BOOL(value) ? "true" : "false");
+	}
+	else if (IS_NUMBER(value)) {
+		printf("%g", AS_NUMBER(value));
+	}
+	else if (IS_INT(value)) {
+		printf("%lld", (long long)AS_INT(value));
+	}
+	else if (IS_OBJ(value)) {
+		printObj(value);
+	}
+#else
 	switch (value.type)
 	{
 	case VAL_NIL:
@@ -67,9 +105,14 @@ void printValue(Value value)
 	case VAL_NUMBER:
 		printf("%g", AS_NUMBER(value));
 		break;
+	case VAL_INT:
+		printf("%lld", (long long)AS_INT(value));
+		break;
 
 	case VAL_OBJ:
 		printObj(value);
 		break;
+	default: break; //VAL_UNDEFINED never reaches the program
 	}
+#endif
 }
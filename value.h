@@ -1,46 +1,126 @@
 #ifndef value_h
 #define value_h
 
+#include <string.h>
 #include "common.h"
 
+typedef struct Obj Obj;
+typedef struct ObjString ObjString;
+
+#ifdef NAN_BOXING
+
+//A double whose quiet NaN bits are all set is not a number but one of the values below. With the
+//sign bit set, the low 48 bits are an Obj pointer; with INT_TAG, a 48 bit int; with neither, one of
+//the TAG_ singletons.
+#define SIGN_BIT ((uint64_t)0x8000000000000000)
+#define QNAN ((uint64_t)0x7ffc000000000000)
+#define INT_TAG ((uint64_t)0x0001000000000000)
+#define INT_PAYLOAD ((uint64_t)0x0000ffffffffffff)
+
+//Ints outside this range become doubles
+#define INT_VALUE_MIN (-((int64_t)1 << 47))
+#define INT_VALUE_MAX (((int64_t)1 << 47) - 1)
+
+#define TAG_NIL 1
+#define TAG_FALSE 2
+#define TAG_TRUE 3
+//Global slot that is not defined yet. Never seen by the program.
+#define TAG_UNDEFINED 4
+
+typedef uint64_t Value;
+
+#define FALSE_VAL ((Value)(uint64_t)(QNAN | TAG_FALSE))
+#define TRUE_VAL ((Value)(uint64_t)(QNAN | TAG_TRUE))
+#define BOOL_VAL(value) ((value) ? TRUE_VAL : FALSE_VAL)
+#define NIL_VAL ((Value)(uint64_t)(QNAN | TAG_NIL))
+#define NUMBER_VAL(value) numberToValue(value)
+#define INT_VAL(value) ((Value)(QNAN | INT_TAG | ((uint64_t)(int64_t)(value) & INT_PAYLOAD)))
+#define OBJ_VAL(object) ((Value)(SIGN_BIT | QNAN | (uint64_t)(uintptr_t)(object)))
+#define UNDEFINED_VAL ((Value)(uint64_t)(QNAN | TAG_UNDEFINED))
+
+#define AS_OBJ(value) ((Obj*)(uintptr_t)((value) & ~(SIGN_BIT | QNAN)))
+#define AS_BOOL(value) ((value) == TRUE_VAL)
+#define AS_NUMBER(value) valueToNumber(value)
+//Sign extended from the 48 bit payload
+#define AS_INT(value) ((int64_t)((value) << 16) >> 16)
+
+//false | 1 is true
+#define IS_BOOL(value) (((value) | 1) == TRUE_VAL)
+#define IS_NIL(value) ((value) == NIL_VAL)
+#define IS_NUMBER(value) (((value) & QNAN) != QNAN)
+#define IS_INT(value) (((value) & (SIGN_BIT | QNAN | INT_TAG)) == (QNAN | INT_TAG))
+#define IS_OBJ(value) (((value) & (QNAN | SIGN_BIT)) == (QNAN | SIGN_BIT))
+#define IS_UNDEFINED(value) ((value) == UNDEFINED_VAL)
+
+static inline double valueToNumber(Value value) {
+	double number;
+	memcpy(&number, &value, sizeof(Value));
+	return number;
+}
+
+static inline Value numberToValue(double number) {
+	Value value;
+	memcpy(&value, &number, sizeof(double));
+	return value;
+}
+
+#else
+
 typedef enum {
 	VAL_BOOL,
 	VAL_NIL,
 	VAL_NUMBER,
+	VAL_INT,
 	//Objects are stored in heap
-	VAL_OBJ
+	VAL_OBJ,
+	//Global slot that is not defined yet. Never seen by the program.
+	VAL_UNDEFINED
 } ValueType;
 
-typedef struct Obj Obj;
-typedef struct ObjString ObjString;
-
 typedef struct {
 	ValueType type;
 	union 
 	{
 		bool boolean;
 		double number;
+		int64_t integer;
 		Obj* obj;
 	} as;
 } Value;
 
+//Ints outside this range become doubles
+#define INT_VALUE_MIN INT64_MIN
+#define INT_VALUE_MAX INT64_MAX
+
 
 #define BOOL_VAL(value) ((Value){VAL_BOOL, {.boolean = value}})
 #define NIL_VAL ((Value){VAL_NIL, {.number = 0}})
 //NURN: primeiro macro no funciona, segundo sim
 //#define NUMBER_VAL(value) (Value)({VAL_NUMBER, {.number = value}})
 #define NUMBER_VAL(value) ((Value){VAL_NUMBER, {.number = value}})
+#define INT_VAL(value) ((Value){VAL_INT, {.integer = value}})
 #define OBJ_VAL(object) ((Value){VAL_OBJ, {.obj = (Obj*)object}})
+#define UNDEFINED_VAL ((Value){VAL_UNDEFINED, {.number = 0}})
 
 #define AS_OBJ(value) ((value).as.obj)
 #define AS_BOOL(value) ((value).as.boolean)
 #define AS_NUMBER(value) ((value).as.number)
+#define AS_INT(value) ((value).as.integer)
 
 
 #define IS_BOOL(value) ((value).type == VAL_BOOL)
 #define IS_NIL(value) ((value).type == VAL_NIL)
 #define IS_NUMBER(value) ((value).type == VAL_NUMBER)
+#define IS_INT(value) ((value).type == VAL_INT)
 #define IS_OBJ(value) ((value).type == VAL_OBJ)
+#define IS_UNDEFINED(value) ((value).type == VAL_UNDEFINED)
+
+#endif
+
+//IS_NUMBER and AS_NUMBER are doubles only. These take either kind of number.
+#define IS_NUMERIC(value) (IS_NUMBER(value) || IS_INT(value))
+#define TO_NUMBER(value) (IS_INT(value) ? (double)AS_INT(value) : AS_NUMBER(value))
+#define INT_FITS(value) ((value) >= INT_VALUE_MIN && (value) <= INT_VALUE_MAX)
 
 typedef struct {
 	int capacity;
@@ -1,3 +1,4 @@
+#include <math.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
@@ -10,6 +11,7 @@ VM vm;
 
 static void resetStack() {
 	vm.stackPtr = vm.stack;
+	memset(vm.openUpvalues, 0, sizeof(ObjUpvalue*) * vm.stackCapacity);
 	vm.frameCount = 0;
 }
 
@@ -21,7 +23,13 @@ static void runtimeError(const char* format, ...) {
 	fputs("\n", stderr);
 
 	//NURN: pq size_t no livro e n int?
+	//Deep recursion only shows both ends of the trace
+	const int shownFrames = 10;
 	for (int i = vm.frameCount - 1;i >= 0;i--) {
+		if (i == vm.frameCount - 1 - shownFrames && i >= shownFrames) {
+			fprintf(stderr, "[... %d more frames]\n", i + 1 - shownFrames);
+			i = shownFrames - 1;
+		}
 		CallFrame* frame = &vm.frames[i];
 		ObjFunction* function = frame->closure->function;
 		size_t instruction = frame->ip - function->chunk.code - 1;
@@ -47,13 +55,25 @@ void initVM()
 	vm.bytesAllocated = 0;
 	vm.nextGC = 1024 * 1024;
 
+	vm.stack = NULL;
+	vm.frames = NULL;
+	vm.stack = GROW_ARRAY(Value, vm.stack, 0, STACK_INITIAL);
+	vm.stackCapacity = STACK_INITIAL;
+	vm.openUpvalues = GROW_ARRAY(ObjUpvalue*, NULL, 0, STACK_INITIAL);
+	vm.frames = GROW_ARRAY(CallFrame, vm.frames, 0, FRAMES_INITIAL);
+	vm.frameCapacity = FRAMES_INITIAL;
+	vm.maxFrames = FRAMES_MAX_DEFAULT;
+
 	resetStack();
+	vm.traceExecution = false;
+	vm.registerBackend = false;
 	vm.objects = NULL;
-	vm.openUpvalues = NULL;
 
 
 	initTable(&vm.internStrings);
-	initTable(&vm.globals);
+	initTable(&vm.globalSlots);
+	initValueArray(&vm.globalValues);
+	initValueArray(&vm.globalNames);
 
 	//Initialize as NULL to avoid GC problems
 	vm.initString = NULL;
@@ -63,11 +83,37 @@ void initVM()
 
 void freeVM()
 {
+#ifdef PROFILE_OPCODES
+	printOpcodeProfile();
+#endif
 	freeObjects();
 	free(vm.grayStack);
 	freeTable(&vm.internStrings);
-	freeTable(&vm.globals);
+	freeTable(&vm.globalSlots);
+	freeValueArray(&vm.globalValues);
+	freeValueArray(&vm.globalNames);
 	vm.initString = NULL;
+
+	FREE_ARRAY(Value, vm.stack, vm.stackCapacity);
+	FREE_ARRAY(ObjUpvalue*, vm.openUpvalues, vm.stackCapacity);
+	vm.openUpvalues = NULL;
+	FREE_ARRAY(CallFrame, vm.frames, vm.frameCapacity);
+	vm.stack = NULL;
+	vm.frames = NULL;
+}
+
+//Slot of the global variable, added undefined the first time the name is seen
+int globalSlot(ObjString* name)
+{
+	Value slot;
+	if (tableGet(&vm.globalSlots, name, &slot)) return (int)AS_NUMBER(slot);
+
+	push(OBJ_VAL(name));
+	writeValueArray(&vm.globalValues, UNDEFINED_VAL);
+	writeValueArray(&vm.globalNames, OBJ_VAL(name));
+	tableSet(&vm.globalSlots, name, NUMBER_VAL(vm.globalValues.count - 1));
+	pop();
+	return vm.globalValues.count - 1;
 }
 
 void push(Value value)
@@ -86,20 +132,102 @@ Value pop()
 	return *vm.stackPtr;
 }
 
+static void traceInstruction(CallFrame* frame) {
+	printf(" ");
+	for (Value* slot = vm.stack; slot < vm.stackPtr; slot++) {
+		printf("[ ");
+		printValue(*slot);
+		printf(" ]");
+	}
+	printf("\n");
+	Chunk* chunk = &frame->closure->function->chunk;
+	dissassembleInstruction(chunk, (int)(frame->ip - chunk->code));
+}
+
+#pragma region Integers
+//Int arithmetic that overflows, or leaves the range an int Value holds, gives a double instead
+static inline Value addInts(int64_t a, int64_t b) {
+	int64_t result;
+#ifdef __GNUC__
+	bool overflow = __builtin_add_overflow(a, b, &result);
+#else
+	bool overflow = (b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b);
+	result = (int64_t)((uint64_t)a + (uint64_t)b);
+#endif
+	return overflow || !INT_FITS(result) ? NUMBER_VAL((double)a + (double)b) : INT_VAL(result);
+}
+static inline Value subtractInts(int64_t a, int64_t b) {
+	int64_t result;
+#ifdef __GNUC__
+	bool overflow = __builtin_sub_overflow(a, b, &result);
+#else
+	bool overflow = (b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b);
+	result = (int64_t)((uint64_t)a - (uint64_t)b);
+#endif
+	return overflow || !INT_FITS(result) ? NUMBER_VAL((double)a - (double)b) : INT_VAL(result);
+}
+static inline Value multiplyInts(int64_t a, int64_t b) {
+	int64_t result;
+#ifdef __GNUC__
+	bool overflow = __builtin_mul_overflow(a, b, &result);
+#else
+	result = (int64_t)((uint64_t)a * (uint64_t)b);
+	bool overflow = a != 0 && b != 0
+		&& ((a == -1 && b == INT64_MIN) || (b == -1 && a == INT64_MIN) || result / b != a);
+#endif
+	return overflow || !INT_FITS(result) ? NUMBER_VAL((double)a * (double)b) : INT_VAL(result);
+}
+//Truncating, b is not 0
+static inline Value divideInts(int64_t a, int64_t b) {
+	return b == -1 ? subtractInts(0, a) : INT_VAL(a / b);
+}
+//Rounded toward zero, as an int when it fits
+static inline Value truncateNumber(double number) {
+	if (number >= (double)INT_VALUE_MIN && number < -(double)INT_VALUE_MIN) return INT_VAL((int64_t)number);
+	//From 2^53 on every double is whole already
+	if (number > -9007199254740992.0 && number < 9007199254740992.0) number = (double)(int64_t)number;
+	return NUMBER_VAL(number);
+}
+static inline Value shiftLeft(int64_t a, int count) {
+	int64_t result = (int64_t)((uint64_t)a << count);
+	if (result >> count == a && INT_FITS(result)) return INT_VAL(result);
+	return NUMBER_VAL((double)a * (double)((uint64_t)1 << count));
+}
+#pragma endregion
+
+//Condition of OP_FOR_PREP / OP_FOR_LOOP, see the FOR_ flags. Both values are numbers.
+static inline bool forCondition(Value counter, Value limit, uint8_t flags) {
+	bool result;
+	if (IS_INT(counter) && IS_INT(limit))
+		result = flags & FOR_GREATER ? AS_INT(counter) > AS_INT(limit) : AS_INT(counter) < AS_INT(limit);
+	else
+		result = flags & FOR_GREATER ? TO_NUMBER(counter) > TO_NUMBER(limit) : TO_NUMBER(counter) < TO_NUMBER(limit);
+	return flags & FOR_NOT ? !result : result;
+}
+
 static bool isFalse(Value value) {
 	return IS_NIL(value) || (IS_BOOL(value) && !AS_BOOL(value));
 }
+//Long results are ropes, flattened once they are compared or printed, so building a string up
+//piece by piece does not copy (and hash) everything so far on every +
 static void concatenate() {
-	ObjString* b = AS_STRING(peek(0));
-	ObjString* a = AS_STRING(peek(1));
-
-	int length = a->length + b->length;
-	char* chars = ALLOCATE(char, length + 1);
-	memcpy(chars, a->chars, a->length);
-	memcpy(chars + a->length, b->chars, b->length);
-	chars[length] = '\0';
-
-	ObjString* result = takeString(chars, length);
+	Obj* b = AS_OBJ(peek(0));
+	Obj* a = AS_OBJ(peek(1));
+
+	Obj* result;
+	int length = textLength(a) + textLength(b);
+	if (length < ROPE_MIN_LENGTH) {
+		//Both halves are shorter still, so neither is a rope
+		ObjString* left = (ObjString*)a;
+		ObjString* right = (ObjString*)b;
+		ObjString* string = allocateString(length);
+		memcpy(string->chars, left->chars, left->length);
+		memcpy(string->chars + left->length, right->chars, right->length);
+		result = (Obj*)takeString(string);
+	}
+	else {
+		result = (Obj*)newRope(a, b);
+	}
 
 	pop();
 	pop();
@@ -107,32 +235,72 @@ static void concatenate() {
 }
 
 #pragma region Calls and methods
+//Grows the value stack so it holds at least needed slots. Frames, open upvalues and vm.stackPtr
+//are moved along; any other pointer into the stack has to be reloaded by its owner.
+static void growStack(int needed) {
+	int oldCapacity = vm.stackCapacity;
+	int capacity = oldCapacity;
+	while (capacity < needed) {
+		capacity = GROW_CAPACITY(capacity);
+	}
+
+	Value* oldStack = vm.stack;
+	vm.stack = GROW_ARRAY(Value, vm.stack, oldCapacity, capacity);
+	vm.openUpvalues = GROW_ARRAY(ObjUpvalue*, vm.openUpvalues, oldCapacity, capacity);
+	memset(vm.openUpvalues + oldCapacity, 0, sizeof(ObjUpvalue*) * (capacity - oldCapacity));
+	vm.stackCapacity = capacity;
+	if (vm.stack == oldStack) return;
+
+	vm.stackPtr = vm.stack + (vm.stackPtr - oldStack);
+	for (int i = 0; i < vm.frameCount; i++) {
+		CallFrame* frame = &vm.frames[i];
+		frame->frameSlots = vm.stack + (frame->frameSlots - oldStack);
+	}
+	for (int i = 0; i < oldCapacity; i++) {
+		if (vm.openUpvalues[i] != NULL) {
+			vm.openUpvalues[i]->location = vm.stack + i;
+		}
+	}
+}
+
 static bool call(ObjClosure* closure, int argCount) {
 	ObjFunction* function = closure->function;
-	int defaultsRequired = 0;
-	if (argCount != function->arity) {
-		if (argCount < function->arity - function->defaults || argCount > function->arity) {
-			//Error message can be improved
-			runtimeError("Expected %d arguments but got %d.", function->arity, argCount);
-			return false;
-		}
 
-		defaultsRequired = function->arity - argCount;
-		for (int i = 0; i < defaultsRequired;i++) {
-			push(NIL_VAL);
-		}
+	if (vm.frameCount == vm.maxFrames) {
+		runtimeError("Stack overflow.");
+		return false;
+	}
+	if (vm.frameCount == vm.frameCapacity) {
+		int oldCapacity = vm.frameCapacity;
+		vm.frameCapacity = GROW_CAPACITY(oldCapacity);
+		vm.frames = GROW_ARRAY(CallFrame, vm.frames, oldCapacity, vm.frameCapacity);
+	}
+	int needed = (int)(vm.stackPtr - vm.stack) + FRAME_STACK_SLOTS;
+	if (needed > vm.stackCapacity) {
+		growStack(needed);
 	}
 
-	CallFrame* frame = &vm.frames[vm.frameCount++];
-	if (vm.frameCount > FRAMES_MAX) {
-		runtimeError("Stack overflow");
+	if (argCount < function->arity - function->defaults || argCount > function->arity) {
+		//Error message can be improved
+		runtimeError("Expected %d arguments but got %d.", function->arity, argCount);
 		return false;
 	}
+
+	//Missing defaults are pushed as stored and the code of the computed ones they need runs first
+	uint8_t* entry = function->chunk.code;
+	if (function->defaults > 0) {
+		int given = argCount - (function->arity - function->defaults);
+		for (int i = given; i < function->defaults; i++) {
+			push(function->defaultValues.values[i]);
+		}
+		entry += function->entries[given];
+	}
+
+	CallFrame* frame = &vm.frames[vm.frameCount++];
 	frame->closure = closure;
-	frame->ip = function->chunk.code;
-	frame->frameSlots = vm.stackPtr - (argCount + defaultsRequired) - 1;
-	frame->defaultsStart = vm.stackPtr - function->defaults;
-	frame->defaultsRequired = defaultsRequired;
+	frame->ip = entry;
+	frame->frameSlots = vm.stackPtr - function->arity - 1;
+	frame->openUpvalues = 0;
 	return true;
 }
 
@@ -149,9 +317,8 @@ static bool callValue(Value callee, int argCount) {
 			ObjClass* klass = AS_CLASS(callee);
 			vm.stackPtr[-argCount - 1] = OBJ_VAL(newInstance(klass));
 
-			Value initializer;
-			if (tableGet(&klass->methods, vm.initString, &initializer)) {
-				return call(AS_CLOSURE(initializer), argCount);
+			if (klass->initializer != NULL) {
+				return call(klass->initializer, argCount);
 			}
 			else if (argCount != 0) {
 				runtimeError("Expected 0 arguments but got %d.", argCount);
@@ -162,69 +329,162 @@ static bool callValue(Value callee, int argCount) {
 		case OBJ_CLOSURE: {
 			return call(AS_CLOSURE(callee), argCount);
 		}
+		case OBJ_STRUCT_TYPE: {
+			ObjStructType* type = AS_STRUCT_TYPE(callee);
+			if (argCount != type->fieldCount) {
+				runtimeError("Expected %d arguments but got %d.", type->fieldCount, argCount);
+				return false;
+			}
+
+			ObjStruct* value = newStruct(type);
+			memcpy(value->fields, vm.stackPtr - argCount, sizeof(Value) * argCount);
+			vm.stackPtr -= argCount;
+			vm.stackPtr[-1] = OBJ_VAL(value);
+			return true;
+		}
+		default: break;
 		}
 	}
 	runtimeError("Can only call functions and classes.");
 	return false;
 }
 
-static bool bindMethod(ObjClass* klass, ObjString* name) {
+#pragma region Inline caches
+//Entry of the cache for instances of the shape, NULL on a miss
+static inline CacheEntry* findCacheEntry(PropertyCache* cache, ObjShape* shape) {
+	for (int i = 0; i < CACHE_WAYS; i++) {
+		if (cache->entries[i].shape == shape) return &cache->entries[i];
+	}
+	return NULL;
+}
+
+//Fills the shape's stale entry, a free one, or once the site is megamorphic the next one in turn
+static CacheEntry* recordCacheEntry(PropertyCache* cache, ObjShape* shape, ObjShape* transition, int slot, ObjClosure* method, int methodVersion) {
+	CacheEntry* entry = NULL;
+	for (int i = 0; i < CACHE_WAYS && entry == NULL; i++) {
+		if (cache->entries[i].shape == shape || cache->entries[i].shape == NULL) entry = &cache->entries[i];
+	}
+	if (entry == NULL) {
+		entry = &cache->entries[cache->nextEvict];
+		cache->nextEvict = (cache->nextEvict + 1) % CACHE_WAYS;
+	}
+
+	entry->shape = shape;
+	entry->transition = transition;
+	entry->slot = slot;
+	entry->method = method;
+	entry->methodVersion = methodVersion;
+	return entry;
+}
+
+//Cache miss of OP_GET_PROPERTY: a field of the shape, else a method of the class.
+//Reports the error and returns NULL when there is neither.
+static CacheEntry* cacheGetProperty(PropertyCache* cache, ObjInstance* instance, ObjString* name) {
+	int slot = shapeSlot(instance->shape, name);
+	if (slot != -1) return recordCacheEntry(cache, instance->shape, NULL, slot, NULL, 0);
+
 	Value method;
-	if (!tableGet(&klass->methods, name, &method)) {
+	if (!tableGet(&instance->klass->methods, name, &method)) {
 		runtimeError("Undefined property '%s'.", name->chars);
-		return false;
+		return NULL;
 	}
+	return recordCacheEntry(cache, instance->shape, NULL, -1, AS_CLOSURE(method), instance->klass->methodVersion);
+}
 
-	ObjBoundMethod* boundMethod = newBoundMethod(peek(0), AS_CLOSURE(method));
+//Cache miss of OP_SET_PROPERTY: the field's slot, and the shape to move to if it is new
+static CacheEntry* cacheSetProperty(PropertyCache* cache, ObjInstance* instance, ObjString* name) {
+	int slot = shapeSlot(instance->shape, name);
+	if (slot != -1) return recordCacheEntry(cache, instance->shape, NULL, slot, NULL, 0);
 
-	pop();
-	push(OBJ_VAL(boundMethod));
-	return true;
+	ObjShape* transition = shapeTransition(instance->shape, name);
+	return recordCacheEntry(cache, instance->shape, transition, transition->slotCount - 1, NULL, 0);
 }
 
-static void defineMethod(ObjString* name) {
-	Value method = peek(0);
-	ObjClass* klass = AS_CLASS(peek(1));
-	//Table set isn't actually setting
-	tableSet(&klass->methods, name, method);
-	//pop();
+//Cache miss of a super access. Classes have no fields, so the entry is keyed by the root shape.
+static CacheEntry* cacheSuperMethod(PropertyCache* cache, ObjClass* superclass, ObjString* name) {
+	Value method;
+	if (!tableGet(&superclass->methods, name, &method)) {
+		runtimeError("Undefined property '%s'.", name->chars);
+		return NULL;
+	}
+	return recordCacheEntry(cache, superclass->rootShape, NULL, -1, AS_CLOSURE(method), superclass->methodVersion);
 }
 #pragma endregion
 
-#pragma region Upvalues
-static ObjUpvalue* captureUpvalue(Value* value) {
-	ObjUpvalue* previousUpvalue = NULL;
-	ObjUpvalue* upvalue = vm.openUpvalues;
-
-	while (upvalue != NULL && upvalue->location > value) {
-		previousUpvalue = upvalue;
-		upvalue = upvalue->next;
+//Field updated in place by OP_INC_PROPERTY / OP_ADD_SET_PROPERTY. Reports the error the
+//get / op / set sequence would have raised and returns NULL when there is no such field.
+static Value* fieldToUpdate(Value receiver, ObjString* name, PropertyCache* cache) {
+	if (IS_STRUCT(receiver)) {
+		ObjStruct* value = AS_STRUCT(receiver);
+		int field = structFieldIndex(value->type, name);
+		if (field == -1) {
+			runtimeError("Undefined property '%s'.", name->chars);
+			return NULL;
+		}
+		return &value->fields[field];
+	}
+	if (!IS_INSTANCE(receiver)) {
+		runtimeError("Only instances have properties.");
+		return NULL;
 	}
 
-	if (upvalue != NULL && upvalue->location == value) {
-		return upvalue;
+	ObjInstance* instance = AS_INSTANCE(receiver);
+	CacheEntry* entry = findCacheEntry(cache, instance->shape);
+	if (entry != NULL) return &instance->fields[entry->slot];
+
+	int slot = shapeSlot(instance->shape, name);
+	if (slot != -1) {
+		recordCacheEntry(cache, instance->shape, NULL, slot, NULL, 0);
+		return &instance->fields[slot];
 	}
 
-	ObjUpvalue* createdUpvalue = newUpvalue(value);
-	createdUpvalue->next = upvalue;
+	Value method;
+	if (tableGet(&instance->klass->methods, name, &method)) {
+		runtimeError("Operands must be two numbers or two strings.");
+	}
+	else {
+		runtimeError("Undefined property '%s'.", name->chars);
+	}
+	return NULL;
+}
 
-	if (previousUpvalue == NULL) {
-		vm.openUpvalues = createdUpvalue;
+static void defineMethod(ObjString* name) {
+	Value method = peek(0);
+	ObjClass* klass = AS_CLASS(peek(1));
+	tableSet(&klass->methods, name, method);
+	klass->methodVersion++;
+	if (name == vm.initString) {
+		klass->initializer = AS_CLOSURE(method);
 	}
-	else{
-		previousUpvalue->next = createdUpvalue;
+	pop();
+}
+#pragma endregion
+
+#pragma region Upvalues
+//Open upvalues are looked up by stack slot. Each frame counts its own, so a return only
+//scans its slots when it has some open.
+static ObjUpvalue* captureUpvalue(CallFrame* frame, Value* slot) {
+	ObjUpvalue** upvalue = &vm.openUpvalues[slot - vm.stack];
+	if (*upvalue == NULL) {
+		*upvalue = newUpvalue(slot);
+		frame->openUpvalues++;
 	}
+	return *upvalue;
+}
+
+static void closeUpvalue(CallFrame* frame, Value* slot) {
+	ObjUpvalue** upvalue = &vm.openUpvalues[slot - vm.stack];
+	if (*upvalue == NULL) return;
 
-	return createdUpvalue;
+	(*upvalue)->closed = *slot;
+	(*upvalue)->location = &(*upvalue)->closed;
+	*upvalue = NULL;
+	frame->openUpvalues--;
 }
 
-static void closeUpvariable(Value* last) {
-	while (vm.openUpvalues != NULL && vm.openUpvalues->location >= last)
-	{
-		ObjUpvalue* upvalue = vm.openUpvalues;
-		upvalue->closed = *upvalue->location;
-		upvalue->location = &upvalue->closed;
-		vm.openUpvalues = upvalue->next;
+static void closeFrameUpvalues(CallFrame* frame) {
+	for (Value* slot = frame->frameSlots; frame->openUpvalues > 0; slot++) {
+		closeUpvalue(frame, slot);
 	}
 }
 #pragma endregion
@@ -247,298 +507,1097 @@ InterpretResult interpret(char* source)
 
 InterpretResult run()
 {
-	CallFrame* currentFrame = &vm.frames[vm.frameCount - 1];
+	//Frame and stack state live in locals so the compiler can keep them in registers.
+	//They are written back only before anything that reads them: calls, returns, allocations and errors.
+	CallFrame* currentFrame;
+	uint8_t* ip;
+	Value* frameSlots;
+	Value* constants;
+	PropertyCache* caches;
+	Value* stackTop;
+	//Nothing is compiled while running, so the global slots cannot move
+	Value* globals = vm.globalValues.values;
+
+#define STORE_FRAME() \
+		do { \
+			currentFrame->ip = ip; \
+			vm.stackPtr = stackTop; \
+		} while (false)
+#define LOAD_FRAME() \
+		do { \
+			currentFrame = &vm.frames[vm.frameCount - 1]; \
+			ip = currentFrame->ip; \
+			frameSlots = currentFrame->frameSlots; \
+			constants = currentFrame->closure->function->chunk.constants.values; \
+			caches = currentFrame->closure->function->caches; \
+			stackTop = vm.stackPtr; \
+		} while (false)
+
+//Operand stack through the cached stack top. vm.stackPtr is only brought up to date
+//before code that reads it: calls, allocations (the GC marks up to it) and errors.
+#define PUSH(value) (*stackTop++ = (value))
+#define POP() (*--stackTop)
+#define PEEK(distance) (stackTop[-1 - (distance)])
+#define DROP(count) (stackTop -= (count))
 
-#define READ_BYTE() (*currentFrame->ip++)
-#define READ_CONSTANT() (currentFrame->closure->function->chunk.constants.values[READ_BYTE()])
+#define READ_BYTE() (*ip++)
+#define READ_CONSTANT() (constants[READ_BYTE()])
 #define READ_STRING() AS_STRING(READ_CONSTANT())
-#define READ_SHORT() (currentFrame->ip +=2, (uint16_t)((currentFrame->ip[-2] << 8) | currentFrame->ip[-1]))
-#define BINARY_OP(valueType, op) \
+#define READ_SHORT() (ip += 2, (uint16_t)((ip[-2] << 8) | ip[-1]))
+#define READ_CACHE() (&caches[READ_SHORT()])
+#define GLOBAL_NAME(slot) (AS_STRING(vm.globalNames.values[slot])->chars)
+#define RUNTIME_ERROR(...) \
 		do { \
-			if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) { \
-				runtimeError("Operands must be numbers."); \
-				return INTERPRET_RUNTIME_ERROR; \
+			STORE_FRAME(); \
+			runtimeError(__VA_ARGS__); \
+			return INTERPRET_RUNTIME_ERROR; \
+		} while (false)
+//Generic form. Two ints quicken it into the _INT form, any other pair of numbers into the _NUM form,
+//which computes mixed operands as doubles. intResult is an expression of a and b.
+#define BINARY_OP(valueType, op, intResult, quickenedInt, quickenedNum) \
+		do { \
+			Value b = PEEK(0); \
+			Value a = PEEK(1); \
+			if (IS_INT(a) && IS_INT(b)) { \
+				ip[-1] = quickenedInt; \
+				DROP(1); \
+				PEEK(0) = intResult; \
+			} \
+			else if (IS_NUMERIC(a) && IS_NUMERIC(b)) { \
+				ip[-1] = quickenedNum; \
+				DROP(1); \
+				PEEK(0) = valueType(TO_NUMBER(a) op TO_NUMBER(b)); \
+			} \
+			else { \
+				RUNTIME_ERROR("Operands must be numbers."); \
 			} \
-			double b = AS_NUMBER(pop()); \
-			double a = AS_NUMBER(pop()); \
-			push(valueType(a op b)); \
 		} while (false)
 
+//Quickened forms. Two ints in the _NUM form, or anything but two ints in the _INT form, turn it back
+//into the generic opcode and rerun it.
+#define NUMBER_OP(valueType, op, generic, genericLabel) \
+		do { \
+			Value b = PEEK(0); \
+			Value a = PEEK(1); \
+			if (IS_NUMBER(a) && IS_NUMBER(b)) { \
+				DROP(1); \
+				PEEK(0) = valueType(AS_NUMBER(a) op AS_NUMBER(b)); \
+			} \
+			else if (IS_NUMERIC(a) && IS_NUMERIC(b) && !(IS_INT(a) && IS_INT(b))) { \
+				DROP(1); \
+				PEEK(0) = valueType(TO_NUMBER(a) op TO_NUMBER(b)); \
+			} \
+			else { \
+				ip[-1] = generic; \
+				goto genericLabel; \
+			} \
+		} while (false)
+#define INT_OP(intResult, generic, genericLabel) \
+		do { \
+			Value b = PEEK(0); \
+			Value a = PEEK(1); \
+			if (!IS_INT(a) || !IS_INT(b)) { \
+				ip[-1] = generic; \
+				goto genericLabel; \
+			} \
+			DROP(1); \
+			PEEK(0) = intResult; \
+		} while (false)
+//Two ints keep the exact remainder, anything else is a double remainder as fmod gives it
+#define MOD_OP(a, b, result) \
+		do { \
+			if (!IS_NUMERIC(a) || !IS_NUMERIC(b)) { \
+				RUNTIME_ERROR("Operand must be a number."); \
+			} \
+			if (IS_INT(a) && IS_INT(b)) { \
+				if (AS_INT(b) == 0) RUNTIME_ERROR("Division by zero."); \
+				result = INT_VAL(AS_INT(b) == -1 ? 0 : AS_INT(a) % AS_INT(b)); \
+			} \
+			else { \
+				double divisor = TO_NUMBER(b); \
+				if (divisor == 0.0) RUNTIME_ERROR("Division by zero."); \
+				result = NUMBER_VAL(fmod(TO_NUMBER(a), divisor)); \
+			} \
+		} while (false)
+#define BITWISE_OP(op) \
+		do { \
+			Value b = PEEK(0); \
+			Value a = PEEK(1); \
+			if (!IS_INT(a) || !IS_INT(b)) { \
+				RUNTIME_ERROR("Operands must be integers."); \
+			} \
+			DROP(1); \
+			PEEK(0) = INT_VAL(AS_INT(a) op AS_INT(b)); \
+		} while (false)
 
-	for (;;) {
-#ifdef DEBUG_TRACE_EXECUTION
-		printf(" ");
-		for (Value* slot = vm.stack; slot < vm.stackPtr; slot++) {
-			printf("[ ");
-			printValue(*slot);
-			printf(" ]");
-		}
-		printf("\n");
-		dissassembleInstruction(&currentFrame->closure->function->chunk, (int)(currentFrame->ip - currentFrame->closure->function->chunk.code));
-#endif // DEBUG_TRACE_EXECUTION
+//Register forms. Both operands are read before dst is written, so dst may alias either of them.
+#define REGISTER_OP(op, intResult, right) \
+		do { \
+			uint8_t dst = READ_BYTE(); \
+			Value a = frameSlots[READ_BYTE()]; \
+			Value b = right; \
+			if (IS_INT(a) && IS_INT(b)) { \
+				frameSlots[dst] = intResult; \
+			} \
+			else if (IS_NUMERIC(a) && IS_NUMERIC(b)) { \
+				frameSlots[dst] = NUMBER_VAL(TO_NUMBER(a) op TO_NUMBER(b)); \
+			} \
+			else { \
+				RUNTIME_ERROR("Operands must be numbers."); \
+			} \
+		} while (false)
+#define REGISTER_MOD(right) \
+		do { \
+			uint8_t dst = READ_BYTE(); \
+			Value a = frameSlots[READ_BYTE()]; \
+			Value b = right; \
+			MOD_OP(a, b, frameSlots[dst]); \
+		} while (false)
+//Compound assignment on the variable target points to, same semantics as OP_ADD
+#define INCREMENT(target, delta) \
+		do { \
+			if (IS_INT(*(target))) { \
+				*(target) = addInts(AS_INT(*(target)), (delta)); \
+			} \
+			else if (IS_NUMBER(*(target))) { \
+				*(target) = NUMBER_VAL(AS_NUMBER(*(target)) + (delta)); \
+			} \
+			else { \
+				RUNTIME_ERROR("Operands must be two numbers or two strings."); \
+			} \
+		} while (false)
+//Adds the value on top of the stack to the variable and replaces it with the sum
+#define ADD_SET(target) \
+		do { \
+			Value b = PEEK(0); \
+			if (IS_INT(*(target)) && IS_INT(b)) { \
+				*(target) = addInts(AS_INT(*(target)), AS_INT(b)); \
+			} \
+			else if (IS_NUMERIC(*(target)) && IS_NUMERIC(b)) { \
+				*(target) = NUMBER_VAL(TO_NUMBER(*(target)) + TO_NUMBER(b)); \
+			} \
+			else if (IS_STRING_OR_ROPE(*(target)) && IS_STRING_OR_ROPE(b)) { \
+				vm.stackPtr = stackTop; \
+				push(*(target)); \
+				push(b); \
+				concatenate(); \
+				*(target) = pop(); \
+			} \
+			else { \
+				RUNTIME_ERROR("Operands must be two numbers or two strings."); \
+			} \
+			PEEK(0) = *(target); \
+		} while (false)
 
-		uint8_t instruction;
-		switch (instruction = READ_BYTE())
-		{
-		case OP_PRINT:
-			printValue(pop());
+//Strings are concatenated on the stack, above every live temporary. lowerToRegisters() packs the
+//temporaries, so every slot below a temporary dst holds a value this frame wrote.
+#define REGISTER_ADD(right) \
+		do { \
+			uint8_t dst = READ_BYTE(); \
+			Value a = frameSlots[READ_BYTE()]; \
+			Value b = right; \
+			if (IS_INT(a) && IS_INT(b)) { \
+				frameSlots[dst] = addInts(AS_INT(a), AS_INT(b)); \
+			} \
+			else if (IS_NUMERIC(a) && IS_NUMERIC(b)) { \
+				frameSlots[dst] = NUMBER_VAL(TO_NUMBER(a) + TO_NUMBER(b)); \
+			} \
+			else if (IS_STRING_OR_ROPE(a) && IS_STRING_OR_ROPE(b)) { \
+				vm.stackPtr = frameSlots + dst > stackTop ? frameSlots + dst : stackTop; \
+				push(a); \
+				push(b); \
+				concatenate(); \
+				frameSlots[dst] = pop(); \
+				vm.stackPtr = stackTop; \
+			} \
+			else { \
+				RUNTIME_ERROR("Operands must be two numbers or two strings."); \
+			} \
+		} while (false)
+
+//Slides the callee and its arguments over the current frame and calls closure in its place.
+//The arity must already be checked, so the call cannot fail.
+#define REUSE_FRAME(closure, argCount) \
+		do { \
+			closeFrameUpvalues(currentFrame); \
+			memmove(frameSlots, stackTop - (argCount) - 1, sizeof(Value) * ((argCount) + 1)); \
+			vm.stackPtr = frameSlots + (argCount) + 1; \
+			vm.frameCount--; \
+			call(closure, argCount); \
+		} while (false)
+
+	LOAD_FRAME();
+
+	//Each handler ends in DISPATCH(). With COMPUTED_GOTO that is an indirect jump of its own,
+	//so the branch predictor gets one history per opcode instead of a single shared switch jump.
+	//Tracing swaps in a table whose every entry is the trace handler, so it costs nothing when off.
+#ifdef COMPUTED_GOTO
+	static void* dispatchTable[] = {
+		[OP_CONSTANT] = &&label_OP_CONSTANT,
+		[OP_NIL] = &&label_OP_NIL,
+		[OP_TRUE] = &&label_OP_TRUE,
+		[OP_FALSE] = &&label_OP_FALSE,
+		[OP_EQUAL] = &&label_OP_EQUAL,
+		[OP_GREATER] = &&label_OP_GREATER,
+		[OP_LESS] = &&label_OP_LESS,
+		[OP_ADD] = &&label_OP_ADD,
+		[OP_SUBTRACT] = &&label_OP_SUBTRACT,
+		[OP_MULTIPLY] = &&label_OP_MULTIPLY,
+		[OP_DIVIDE] = &&label_OP_DIVIDE,
+		[OP_MOD] = &&label_OP_MOD,
+		[OP_NOT] = &&label_OP_NOT,
+		[OP_NEGATE] = &&label_OP_NEGATE,
+		[OP_INT_DIVIDE] = &&label_OP_INT_DIVIDE,
+		[OP_BIT_AND] = &&label_OP_BIT_AND,
+		[OP_BIT_OR] = &&label_OP_BIT_OR,
+		[OP_BIT_XOR] = &&label_OP_BIT_XOR,
+		[OP_SHIFT_LEFT] = &&label_OP_SHIFT_LEFT,
+		[OP_SHIFT_RIGHT] = &&label_OP_SHIFT_RIGHT,
+		[OP_BIT_NOT] = &&label_OP_BIT_NOT,
+		[OP_POP] = &&label_OP_POP,
+		[OP_DEFINE_GLOBAL] = &&label_OP_DEFINE_GLOBAL,
+		[OP_GET_GLOBAL] = &&label_OP_GET_GLOBAL,
+		[OP_SET_GLOBAL] = &&label_OP_SET_GLOBAL,
+		[OP_GET_LOCAL] = &&label_OP_GET_LOCAL,
+		[OP_SET_LOCAL] = &&label_OP_SET_LOCAL,
+		[OP_PRINT] = &&label_OP_PRINT,
+		[OP_JUMP] = &&label_OP_JUMP,
+		[OP_JUMP_IF_FALSE] = &&label_OP_JUMP_IF_FALSE,
+		[OP_LOOP] = &&label_OP_LOOP,
+		[OP_CLOSURE] = &&label_OP_CLOSURE,
+		[OP_CLOSURE_SHARED] = &&label_OP_CLOSURE_SHARED,
+		[OP_SET_UPVALUE] = &&label_OP_SET_UPVALUE,
+		[OP_GET_UPVALUE] = &&label_OP_GET_UPVALUE,
+		[OP_GET_CAPTURED] = &&label_OP_GET_CAPTURED,
+		[OP_CLOSE_UPVALUE] = &&label_OP_CLOSE_UPVALUE,
+		[OP_CLASS] = &&label_OP_CLASS,
+		[OP_SET_PROPERTY] = &&label_OP_SET_PROPERTY,
+		[OP_GET_PROPERTY] = &&label_OP_GET_PROPERTY,
+		[OP_METHOD] = &&label_OP_METHOD,
+		[OP_INHERIT] = &&label_OP_INHERIT,
+		[OP_GET_SUPER] = &&label_OP_GET_SUPER,
+		[OP_SUPER_INVOKE] = &&label_OP_SUPER_INVOKE,
+		[OP_GET_FIELD] = &&label_OP_GET_FIELD,
+		[OP_SET_FIELD] = &&label_OP_SET_FIELD,
+		[OP_CALL] = &&label_OP_CALL,
+		[OP_TAIL_CALL] = &&label_OP_TAIL_CALL,
+		[OP_INVOKE] = &&label_OP_INVOKE,
+		[OP_TAIL_INVOKE] = &&label_OP_TAIL_INVOKE,
+		[OP_RETURN] = &&label_OP_RETURN,
+		[OP_GET_LOCAL_CONSTANT] = &&label_OP_GET_LOCAL_CONSTANT,
+		[OP_GET_LOCAL_GET_LOCAL] = &&label_OP_GET_LOCAL_GET_LOCAL,
+		[OP_GET_LOCAL_PROPERTY] = &&label_OP_GET_LOCAL_PROPERTY,
+		[OP_GET_LOCAL_FIELD] = &&label_OP_GET_LOCAL_FIELD,
+		[OP_SET_LOCAL_POP] = &&label_OP_SET_LOCAL_POP,
+		[OP_JUMP_IF_FALSE_POP] = &&label_OP_JUMP_IF_FALSE_POP,
+		[OP_GREATER_NUM] = &&label_OP_GREATER_NUM,
+		[OP_LESS_NUM] = &&label_OP_LESS_NUM,
+		[OP_ADD_NUM] = &&label_OP_ADD_NUM,
+		[OP_SUBTRACT_NUM] = &&label_OP_SUBTRACT_NUM,
+		[OP_MULTIPLY_NUM] = &&label_OP_MULTIPLY_NUM,
+		[OP_DIVIDE_NUM] = &&label_OP_DIVIDE_NUM,
+		[OP_GREATER_INT] = &&label_OP_GREATER_INT,
+		[OP_LESS_INT] = &&label_OP_LESS_INT,
+		[OP_ADD_INT] = &&label_OP_ADD_INT,
+		[OP_SUBTRACT_INT] = &&label_OP_SUBTRACT_INT,
+		[OP_MULTIPLY_INT] = &&label_OP_MULTIPLY_INT,
+		[OP_R_MOVE] = &&label_OP_R_MOVE,
+		[OP_R_LOADK] = &&label_OP_R_LOADK,
+		[OP_R_ADD] = &&label_OP_R_ADD,
+		[OP_R_SUBTRACT] = &&label_OP_R_SUBTRACT,
+		[OP_R_MULTIPLY] = &&label_OP_R_MULTIPLY,
+		[OP_R_DIVIDE] = &&label_OP_R_DIVIDE,
+		[OP_R_ADDK] = &&label_OP_R_ADDK,
+		[OP_R_SUBTRACTK] = &&label_OP_R_SUBTRACTK,
+		[OP_R_MULTIPLYK] = &&label_OP_R_MULTIPLYK,
+		[OP_R_DIVIDEK] = &&label_OP_R_DIVIDEK,
+		[OP_R_MOD] = &&label_OP_R_MOD,
+		[OP_R_MODK] = &&label_OP_R_MODK,
+		[OP_FOR_PREP] = &&label_OP_FOR_PREP,
+		[OP_FOR_LOOP] = &&label_OP_FOR_LOOP,
+		[OP_DUP] = &&label_OP_DUP,
+		[OP_INC_LOCAL] = &&label_OP_INC_LOCAL,
+		[OP_INC_UPVALUE] = &&label_OP_INC_UPVALUE,
+		[OP_INC_GLOBAL] = &&label_OP_INC_GLOBAL,
+		[OP_INC_PROPERTY] = &&label_OP_INC_PROPERTY,
+		[OP_ADD_SET_LOCAL] = &&label_OP_ADD_SET_LOCAL,
+		[OP_ADD_SET_UPVALUE] = &&label_OP_ADD_SET_UPVALUE,
+		[OP_ADD_SET_GLOBAL] = &&label_OP_ADD_SET_GLOBAL,
+		[OP_ADD_SET_PROPERTY] = &&label_OP_ADD_SET_PROPERTY,
+	};
+	static void* traceTable[] = {
+		[0 ... UINT8_MAX] = &&label_TRACE
+	};
+#ifdef PROFILE_OPCODES
+	void** dispatch = traceTable;
+#else
+	void** dispatch = vm.traceExecution ? traceTable : dispatchTable;
+#endif
+
+#define CASE(op) label_##op
+#define DISPATCH() goto *dispatch[READ_BYTE()]
+#define INTERPRET_LOOP DISPATCH();
+#else
+#define CASE(op) case op
+#define DISPATCH() goto loop
+#define INTERPRET_LOOP \
+		loop: \
+		PROFILE_INSTRUCTION(); \
+		if (vm.traceExecution) { \
+			STORE_FRAME(); \
+			traceInstruction(currentFrame); \
+		} \
+		switch (READ_BYTE())
+#endif // COMPUTED_GOTO
+
+#ifdef PROFILE_OPCODES
+#define PROFILE_INSTRUCTION() profileInstruction(&currentFrame->closure->function->chunk, ip)
+#else
+#define PROFILE_INSTRUCTION() do { } while (false)
+#endif
+
+	INTERPRET_LOOP
+	{
+#ifdef COMPUTED_GOTO
+		label_TRACE:
+			ip--;
+			PROFILE_INSTRUCTION();
+			if (vm.traceExecution) {
+				STORE_FRAME();
+				traceInstruction(currentFrame);
+			}
+			goto *dispatchTable[READ_BYTE()];
+#endif // COMPUTED_GOTO
+
+		CASE(OP_PRINT):
+			//Printing a rope flattens it, which allocates
+			vm.stackPtr = stackTop;
+			printValue(PEEK(0));
 			printf("\n");
-			break;
-		case OP_POP: pop(); break;
+			DROP(1);
+			DISPATCH();
+		CASE(OP_POP): DROP(1); DISPATCH();
+		CASE(OP_DUP): {
+			//PUSH(PEEK(0)) would read stackTop unsequenced with its increment
+			Value top = PEEK(0);
+			PUSH(top);
+			DISPATCH();
+		}
 
 #pragma region Values
-		case OP_CONSTANT:
-			push(READ_CONSTANT());
-			break;
-		case OP_NIL:
-			push(NIL_VAL);
-			break;
-		case OP_TRUE:
-			push(BOOL_VAL(true));
-			break;
-		case OP_FALSE:
-			push(BOOL_VAL(false));
-			break;
+		CASE(OP_CONSTANT):
+			PUSH(READ_CONSTANT());
+			DISPATCH();
+		CASE(OP_NIL):
+			PUSH(NIL_VAL);
+			DISPATCH();
+		CASE(OP_TRUE):
+			PUSH(BOOL_VAL(true));
+			DISPATCH();
+		CASE(OP_FALSE):
+			PUSH(BOOL_VAL(false));
+			DISPATCH();
 #pragma endregion
 
 #pragma region Arithmetic
-		case OP_EQUAL: {
-			Value b = pop();
-			Value a = pop();
-			push(BOOL_VAL(valuesEqual(a, b)));
-			break;
+		CASE(OP_EQUAL): {
+			//So does comparing one
+			vm.stackPtr = stackTop;
+			Value b = POP();
+			PEEK(0) = BOOL_VAL(valuesEqual(PEEK(0), b));
+			DISPATCH();
 		}
 
-		case OP_GREATER:
-			BINARY_OP(BOOL_VAL, >);
-			break;
+		CASE(OP_GREATER):
+		greater:
+			BINARY_OP(BOOL_VAL, >, BOOL_VAL(AS_INT(a) > AS_INT(b)), OP_GREATER_INT, OP_GREATER_NUM);
+			DISPATCH();
 
-		case OP_LESS:
-			BINARY_OP(BOOL_VAL, < );
-			break;
+		CASE(OP_LESS):
+		less:
+			BINARY_OP(BOOL_VAL, <, BOOL_VAL(AS_INT(a) < AS_INT(b)), OP_LESS_INT, OP_LESS_NUM);
+			DISPATCH();
 
-		case OP_NOT:
-			push(BOOL_VAL(isFalse(pop())));
-			break;
+		CASE(OP_NOT):
+			PEEK(0) = BOOL_VAL(isFalse(PEEK(0)));
+			DISPATCH();
 
-		case OP_NEGATE: 
-			if (!IS_NUMBER(peek(0))) {
-				runtimeError("Operand must be a number.");
-				return INTERPRET_RUNTIME_ERROR;
+		CASE(OP_NEGATE): 
+			if (IS_INT(PEEK(0))) {
+				PEEK(0) = subtractInts(0, AS_INT(PEEK(0)));
+				DISPATCH();
 			}
-			push(NUMBER_VAL(-AS_NUMBER(pop()))); break;
-		case OP_ADD: {
-			if (IS_NUMBER(peek(0)) && IS_NUMBER(peek(1))) {
-				BINARY_OP(NUMBER_VAL, +);
+			if (!IS_NUMBER(PEEK(0))) {
+				RUNTIME_ERROR("Operand must be a number.");
 			}
-			else if (IS_STRING(peek(0)) && IS_STRING(peek(1))) {
+			PEEK(0) = NUMBER_VAL(-AS_NUMBER(PEEK(0)));
+			DISPATCH();
+		CASE(OP_ADD):
+		add: {
+			if (IS_NUMERIC(PEEK(0)) && IS_NUMERIC(PEEK(1))) {
+				BINARY_OP(NUMBER_VAL, +, addInts(AS_INT(a), AS_INT(b)), OP_ADD_INT, OP_ADD_NUM);
+			}
+			else if (IS_STRING_OR_ROPE(PEEK(0)) && IS_STRING_OR_ROPE(PEEK(1))) {
+				vm.stackPtr = stackTop;
 				concatenate();
+				stackTop = vm.stackPtr;
 			}
 			else {
-				runtimeError("Operands must be two numbers or two strings.");
-				return INTERPRET_RUNTIME_ERROR;
+				RUNTIME_ERROR("Operands must be two numbers or two strings.");
 			}
-			break;
+			DISPATCH();
 		}
-		case OP_SUBTRACT: BINARY_OP(NUMBER_VAL, -); break;
-		case OP_MULTIPLY: BINARY_OP(NUMBER_VAL, *); break;
-		case OP_DIVIDE: BINARY_OP(NUMBER_VAL , /); break;
-		case OP_MOD: {
-			if (!IS_NUMBER(peek(0)) || !IS_NUMBER(peek(1))) {
-				runtimeError("Operand must be a number.");
-				return INTERPRET_RUNTIME_ERROR;
+		CASE(OP_SUBTRACT): subtract: BINARY_OP(NUMBER_VAL, -, subtractInts(AS_INT(a), AS_INT(b)), OP_SUBTRACT_INT, OP_SUBTRACT_NUM); DISPATCH();
+		CASE(OP_MULTIPLY): multiply: BINARY_OP(NUMBER_VAL, *, multiplyInts(AS_INT(a), AS_INT(b)), OP_MULTIPLY_INT, OP_MULTIPLY_NUM); DISPATCH();
+		//Always true division, ~/ is the truncating one
+		CASE(OP_DIVIDE): divide: BINARY_OP(NUMBER_VAL, /, NUMBER_VAL((double)AS_INT(a) / (double)AS_INT(b)), OP_DIVIDE, OP_DIVIDE_NUM); DISPATCH();
+		CASE(OP_MOD): {
+			Value b = POP();
+			MOD_OP(PEEK(0), b, PEEK(0));
+			DISPATCH();
+		}
+		CASE(OP_INT_DIVIDE): {
+			Value b = PEEK(0);
+			Value a = PEEK(1);
+			if (!IS_NUMERIC(a) || !IS_NUMERIC(b)) {
+				RUNTIME_ERROR("Operands must be numbers.");
+			}
+			if (TO_NUMBER(b) == 0) {
+				RUNTIME_ERROR("Division by zero.");
 			}
-			int b = (int)AS_NUMBER(pop());
-			int a = (int)AS_NUMBER(pop());
-			push(NUMBER_VAL(a % b));
-			break;
+			DROP(1);
+			if (IS_INT(a) && IS_INT(b))
+				PEEK(0) = divideInts(AS_INT(a), AS_INT(b));
+			else
+				PEEK(0) = truncateNumber(TO_NUMBER(a) / TO_NUMBER(b));
+			DISPATCH();
 		}
+		CASE(OP_BIT_AND): BITWISE_OP(&); DISPATCH();
+		CASE(OP_BIT_OR): BITWISE_OP(|); DISPATCH();
+		CASE(OP_BIT_XOR): BITWISE_OP(^); DISPATCH();
+		CASE(OP_SHIFT_LEFT):
+		CASE(OP_SHIFT_RIGHT): {
+			Value b = PEEK(0);
+			Value a = PEEK(1);
+			if (!IS_INT(a) || !IS_INT(b)) {
+				RUNTIME_ERROR("Operands must be integers.");
+			}
+			if (AS_INT(b) < 0 || AS_INT(b) > 63) {
+				RUNTIME_ERROR("Shift count out of range.");
+			}
+			DROP(1);
+			if (ip[-1] == OP_SHIFT_LEFT)
+				PEEK(0) = shiftLeft(AS_INT(a), (int)AS_INT(b));
+			else
+				PEEK(0) = INT_VAL(AS_INT(a) >> AS_INT(b));
+			DISPATCH();
+		}
+		CASE(OP_BIT_NOT):
+			if (!IS_INT(PEEK(0))) {
+				RUNTIME_ERROR("Operand must be an integer.");
+			}
+			PEEK(0) = INT_VAL(~AS_INT(PEEK(0)));
+			DISPATCH();
+#pragma endregion
+
+#pragma region Quickened arithmetic
+		CASE(OP_GREATER_NUM): NUMBER_OP(BOOL_VAL, >, OP_GREATER, greater); DISPATCH();
+		CASE(OP_LESS_NUM): NUMBER_OP(BOOL_VAL, <, OP_LESS, less); DISPATCH();
+		CASE(OP_ADD_NUM): NUMBER_OP(NUMBER_VAL, +, OP_ADD, add); DISPATCH();
+		CASE(OP_SUBTRACT_NUM): NUMBER_OP(NUMBER_VAL, -, OP_SUBTRACT, subtract); DISPATCH();
+		CASE(OP_MULTIPLY_NUM): NUMBER_OP(NUMBER_VAL, *, OP_MULTIPLY, multiply); DISPATCH();
+		CASE(OP_DIVIDE_NUM): NUMBER_OP(NUMBER_VAL, /, OP_DIVIDE, divide); DISPATCH();
+		CASE(OP_GREATER_INT): INT_OP(BOOL_VAL(AS_INT(a) > AS_INT(b)), OP_GREATER, greater); DISPATCH();
+		CASE(OP_LESS_INT): INT_OP(BOOL_VAL(AS_INT(a) < AS_INT(b)), OP_LESS, less); DISPATCH();
+		CASE(OP_ADD_INT): INT_OP(addInts(AS_INT(a), AS_INT(b)), OP_ADD, add); DISPATCH();
+		CASE(OP_SUBTRACT_INT): INT_OP(subtractInts(AS_INT(a), AS_INT(b)), OP_SUBTRACT, subtract); DISPATCH();
+		CASE(OP_MULTIPLY_INT): INT_OP(multiplyInts(AS_INT(a), AS_INT(b)), OP_MULTIPLY, multiply); DISPATCH();
+#pragma endregion
+
+#pragma region Register backend
+		CASE(OP_R_MOVE): {
+			uint8_t dst = READ_BYTE();
+			frameSlots[dst] = frameSlots[READ_BYTE()];
+			DISPATCH();
+		}
+		CASE(OP_R_LOADK): {
+			uint8_t dst = READ_BYTE();
+			frameSlots[dst] = READ_CONSTANT();
+			DISPATCH();
+		}
+		CASE(OP_R_ADD): REGISTER_ADD(frameSlots[READ_BYTE()]); DISPATCH();
+		CASE(OP_R_SUBTRACT): REGISTER_OP(-, subtractInts(AS_INT(a), AS_INT(b)), frameSlots[READ_BYTE()]); DISPATCH();
+		CASE(OP_R_MULTIPLY): REGISTER_OP(*, multiplyInts(AS_INT(a), AS_INT(b)), frameSlots[READ_BYTE()]); DISPATCH();
+		CASE(OP_R_DIVIDE): REGISTER_OP(/, NUMBER_VAL((double)AS_INT(a) / (double)AS_INT(b)), frameSlots[READ_BYTE()]); DISPATCH();
+		CASE(OP_R_ADDK): REGISTER_ADD(READ_CONSTANT()); DISPATCH();
+		CASE(OP_R_SUBTRACTK): REGISTER_OP(-, subtractInts(AS_INT(a), AS_INT(b)), READ_CONSTANT()); DISPATCH();
+		CASE(OP_R_MULTIPLYK): REGISTER_OP(*, multiplyInts(AS_INT(a), AS_INT(b)), READ_CONSTANT()); DISPATCH();
+		CASE(OP_R_DIVIDEK): REGISTER_OP(/, NUMBER_VAL((double)AS_INT(a) / (double)AS_INT(b)), READ_CONSTANT()); DISPATCH();
+		CASE(OP_R_MOD): REGISTER_MOD(frameSlots[READ_BYTE()]); DISPATCH();
+		CASE(OP_R_MODK): REGISTER_MOD(READ_CONSTANT()); DISPATCH();
 #pragma endregion
 
 #pragma region Variables
-		case OP_DEFINE_GLOBAL: {
-			ObjString* name = READ_STRING();
-			tableSet(&vm.globals, name, peek(0));
-			pop();
-			break;
+		CASE(OP_DEFINE_GLOBAL): {
+			globals[READ_SHORT()] = POP();
+			DISPATCH();
 		}
-		case OP_GET_GLOBAL: {
-			ObjString* name = READ_STRING();
-			Value value;
-			if (!tableGet(&vm.globals, name, &value)) {
-				runtimeError("Undefined variable '%s'.", name->chars);
-				return INTERPRET_RUNTIME_ERROR;
+		CASE(OP_GET_GLOBAL): {
+			uint16_t slot = READ_SHORT();
+			Value value = globals[slot];
+			if (IS_UNDEFINED(value)) {
+				RUNTIME_ERROR("Undefined variable '%s'.", GLOBAL_NAME(slot));
 			}
-			push(value);
-			break;
+			PUSH(value);
+			DISPATCH();
 		}
-		case OP_SET_GLOBAL: {
-			ObjString* name = READ_STRING();
-			if (tableSet(&vm.globals, name, peek(0))) {
-				tableDelete(&vm.globals, name);
-				runtimeError("Undefined variable '%s'.", name->chars);
-				return INTERPRET_RUNTIME_ERROR;
+		CASE(OP_SET_GLOBAL): {
+			uint16_t slot = READ_SHORT();
+			if (IS_UNDEFINED(globals[slot])) {
+				RUNTIME_ERROR("Undefined variable '%s'.", GLOBAL_NAME(slot));
 			}
-			break;
+			globals[slot] = PEEK(0);
+			DISPATCH();
 		}
 
-		case OP_GET_LOCAL: {
+		CASE(OP_GET_LOCAL): {
 			uint8_t slot = READ_BYTE();
-			push(currentFrame->frameSlots[slot]);
-			break;
+			PUSH(frameSlots[slot]);
+			DISPATCH();
 		}
 
-		case OP_SET_LOCAL: {
+		CASE(OP_SET_LOCAL): {
 			uint8_t slot = READ_BYTE();
-			currentFrame->frameSlots[slot] = peek(0);
-			break;
+			frameSlots[slot] = PEEK(0);
+			DISPATCH();
 		}
 #pragma endregion
 
 #pragma region Control Flow
-		case OP_JUMP_IF_FALSE: {
+		CASE(OP_JUMP_IF_FALSE): {
 			uint16_t jumpOffset = READ_SHORT();
-			if (isFalse(peek(0)))
-				currentFrame->ip += jumpOffset;
-			break;
+			if (isFalse(PEEK(0)))
+				ip += jumpOffset;
+			DISPATCH();
 		}
-		case OP_JUMP: {
+		CASE(OP_JUMP): {
 			uint16_t jumpOffset = READ_SHORT();
-			currentFrame->ip += jumpOffset;
-			break;
+			ip += jumpOffset;
+			DISPATCH();
 		}
-		case OP_LOOP: {
+		//Counted loops. The guards raise the errors the generic increment and comparison would.
+		CASE(OP_FOR_PREP): {
+			uint8_t slot = READ_BYTE();
+			uint8_t limit = READ_BYTE();
+			uint8_t flags = READ_BYTE();
+			uint16_t jumpOffset = READ_SHORT();
+			Value counter = frameSlots[slot];
+			Value bound = flags & FOR_CONSTANT_LIMIT ? constants[limit] : frameSlots[limit];
+			if (!IS_NUMERIC(counter) || !IS_NUMERIC(bound)) {
+				RUNTIME_ERROR("Operands must be numbers.");
+			}
+			if (!forCondition(counter, bound, flags))
+				ip += jumpOffset;
+			DISPATCH();
+		}
+		CASE(OP_FOR_LOOP): {
+			uint8_t slot = READ_BYTE();
+			uint8_t limit = READ_BYTE();
+			uint8_t flags = READ_BYTE();
+			Value step = READ_CONSTANT();
+			uint16_t jumpOffset = READ_SHORT();
+			Value counter = frameSlots[slot];
+			if (!IS_NUMERIC(counter)) {
+				if (flags & FOR_SUBTRACT) {
+					RUNTIME_ERROR("Operands must be numbers.");
+				}
+				RUNTIME_ERROR("Operands must be two numbers or two strings.");
+			}
+			Value next;
+			if (IS_INT(counter) && IS_INT(step))
+				next = flags & FOR_SUBTRACT ? subtractInts(AS_INT(counter), AS_INT(step)) : addInts(AS_INT(counter), AS_INT(step));
+			else
+				next = NUMBER_VAL(flags & FOR_SUBTRACT ? TO_NUMBER(counter) - TO_NUMBER(step) : TO_NUMBER(counter) + TO_NUMBER(step));
+			frameSlots[slot] = next;
+
+			Value bound = flags & FOR_CONSTANT_LIMIT ? constants[limit] : frameSlots[limit];
+			if (!IS_NUMERIC(bound)) {
+				RUNTIME_ERROR("Operands must be numbers.");
+			}
+			if (forCondition(next, bound, flags))
+				ip -= jumpOffset;
+			DISPATCH();
+		}
+		CASE(OP_LOOP): {
 			uint16_t loopOffset = READ_SHORT();
-			currentFrame->ip -= loopOffset;
-			break;
+			ip -= loopOffset;
+			DISPATCH();
 		}
 #pragma endregion
 
 #pragma region Closures
-		case OP_CLOSURE: {
+		CASE(OP_CLOSURE): {
 			ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
+			vm.stackPtr = stackTop;
 			ObjClosure* closure = newClosure(function);
+			//Pushed before capturing so the GC can see it while upvalues are allocated
+			PUSH(OBJ_VAL(closure));
+			vm.stackPtr = stackTop;
 
 			for (int i = 0;i < closure->upvalueCount;i++) {
-				uint8_t isLocal = READ_BYTE();
+				uint8_t capture = READ_BYTE();
 				uint8_t index = READ_BYTE();
 
-				if (isLocal) {
-					closure->upvalues[i] = captureUpvalue(currentFrame->frameSlots + index);
+				if (capture == CAPTURE_LOCAL) {
+					closure->upvalues[i] = OBJ_VAL(captureUpvalue(currentFrame, frameSlots + index));
+				}
+				else if (capture == CAPTURE_LOCAL_VALUE) {
+					closure->upvalues[i] = frameSlots[index];
 				}
 				else{
 					closure->upvalues[i] = currentFrame->closure->upvalues[index];
 				}
 			}
-			push(OBJ_VAL(closure));
 
-			break;
+			DISPATCH();
+		}
+		CASE(OP_CLOSURE_SHARED): {
+			ObjFunction* function = AS_FUNCTION(READ_CONSTANT());
+			if (function->sharedClosure == NULL) {
+				vm.stackPtr = stackTop;
+				function->sharedClosure = newClosure(function);
+			}
+			PUSH(OBJ_VAL(function->sharedClosure));
+			DISPATCH();
+		}
+#pragma region Compound assignment
+		CASE(OP_INC_LOCAL): {
+			Value* target = &frameSlots[READ_BYTE()];
+			INCREMENT(target, (int8_t)READ_BYTE());
+			PUSH(*target);
+			DISPATCH();
+		}
+		CASE(OP_INC_UPVALUE): {
+			Value* target = AS_UPVALUE(currentFrame->closure->upvalues[READ_BYTE()])->location;
+			INCREMENT(target, (int8_t)READ_BYTE());
+			PUSH(*target);
+			DISPATCH();
+		}
+		CASE(OP_INC_GLOBAL): {
+			uint16_t slot = READ_SHORT();
+			Value* target = &globals[slot];
+			if (IS_UNDEFINED(*target)) {
+				RUNTIME_ERROR("Undefined variable '%s'.", GLOBAL_NAME(slot));
+			}
+			INCREMENT(target, (int8_t)READ_BYTE());
+			PUSH(*target);
+			DISPATCH();
+		}
+		CASE(OP_INC_PROPERTY): {
+			STORE_FRAME();
+			ObjString* name = READ_STRING();
+			Value* target = fieldToUpdate(PEEK(0), name, READ_CACHE());
+			if (target == NULL) return INTERPRET_RUNTIME_ERROR;
+			INCREMENT(target, (int8_t)READ_BYTE());
+			PEEK(0) = *target;
+			DISPATCH();
+		}
+		CASE(OP_ADD_SET_LOCAL): {
+			Value* target = &frameSlots[READ_BYTE()];
+			ADD_SET(target);
+			DISPATCH();
+		}
+		CASE(OP_ADD_SET_UPVALUE): {
+			Value* target = AS_UPVALUE(currentFrame->closure->upvalues[READ_BYTE()])->location;
+			ADD_SET(target);
+			DISPATCH();
+		}
+		CASE(OP_ADD_SET_GLOBAL): {
+			uint16_t slot = READ_SHORT();
+			Value* target = &globals[slot];
+			if (IS_UNDEFINED(*target)) {
+				RUNTIME_ERROR("Undefined variable '%s'.", GLOBAL_NAME(slot));
+			}
+			ADD_SET(target);
+			DISPATCH();
+		}
+		CASE(OP_ADD_SET_PROPERTY): {
+			STORE_FRAME();
+			ObjString* name = READ_STRING();
+			Value* target = fieldToUpdate(PEEK(1), name, READ_CACHE());
+			if (target == NULL) return INTERPRET_RUNTIME_ERROR;
+			ADD_SET(target);
+			Value value = POP();
+			PEEK(0) = value;
+			DISPATCH();
+		}
+#pragma endregion
+
+		CASE(OP_GET_UPVALUE): {
+			uint8_t slot = READ_BYTE();
+			PUSH(*AS_UPVALUE(currentFrame->closure->upvalues[slot])->location);
+			DISPATCH();
 		}
-		case OP_GET_UPVALUE: {
+		CASE(OP_GET_CAPTURED): {
 			uint8_t slot = READ_BYTE();
-			push(*currentFrame->closure->upvalues[slot]->location);
-			break;
+			PUSH(currentFrame->closure->upvalues[slot]);
+			DISPATCH();
 		}
-		case OP_SET_UPVALUE: {
+		CASE(OP_SET_UPVALUE): {
 			uint8_t slot = READ_BYTE();
-			*currentFrame->closure->upvalues[slot]->location = peek(0);
-			break;
+			*AS_UPVALUE(currentFrame->closure->upvalues[slot])->location = PEEK(0);
+			DISPATCH();
 		}
-		case OP_CLOSE_UPVALUE: {
-			closeUpvariable(vm.stackPtr - 1);
-			pop();
-			break;
+		CASE(OP_CLOSE_UPVALUE): {
+			closeUpvalue(currentFrame, stackTop - 1);
+			DROP(1);
+			DISPATCH();
 		}
 #pragma endregion
 
 #pragma region Functions
-		case OP_SET_DEFAULT: {
-			int defCount = READ_BYTE();
-			if (defCount < currentFrame->closure->function->defaults - currentFrame->defaultsRequired) {
-				pop();
-				break;
+		CASE(OP_CALL): {
+			int argCount = READ_BYTE();
+			STORE_FRAME();
+			if (!callValue(PEEK(argCount), argCount)) {
+				return INTERPRET_RUNTIME_ERROR;
 			}
-			Value def = pop();
-			currentFrame->defaultsStart[defCount] = def;
-			break;
+
+			LOAD_FRAME();
+			DISPATCH();
 		}
 
-		case OP_CALL: {
+		CASE(OP_TAIL_CALL): {
 			int argCount = READ_BYTE();
-			if (!callValue(peek(argCount), argCount)) {
-				return INTERPRET_RUNTIME_ERROR;
+			Value callee = PEEK(argCount);
+			Value* args = stackTop - argCount - 1;
+			ObjClosure* closure = NULL;
+			if (IS_CLOSURE(callee)) {
+				closure = AS_CLOSURE(callee);
+			}
+			else if (IS_BOUND_METHOD(callee)) {
+				closure = AS_BOUND_METHOD(callee)->method;
+				args[0] = AS_BOUND_METHOD(callee)->receiver;
+			}
+
+			//Classes and wrong argument counts go through an ordinary call, so errors report this frame
+			ObjFunction* function = closure != NULL ? closure->function : NULL;
+			if (function == NULL || argCount > function->arity || argCount < function->arity - function->defaults) {
+				STORE_FRAME();
+				if (!callValue(callee, argCount)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				LOAD_FRAME();
+				DISPATCH();
+			}
+
+			REUSE_FRAME(closure, argCount);
+			LOAD_FRAME();
+			DISPATCH();
+		}
+
+		CASE(OP_INVOKE):
+		CASE(OP_TAIL_INVOKE): {
+			bool tail = ip[-1] == OP_TAIL_INVOKE;
+			ObjString* name = READ_STRING();
+			PropertyCache* cache = READ_CACHE();
+			int argCount = READ_BYTE();
+			if (IS_STRUCT(PEEK(argCount))) {
+				ObjStruct* value = AS_STRUCT(PEEK(argCount));
+				int field = structFieldIndex(value->type, name);
+				if (field == -1) {
+					RUNTIME_ERROR("Undefined property '%s'.", name->chars);
+				}
+				PEEK(argCount) = value->fields[field];
+				STORE_FRAME();
+				if (!callValue(PEEK(argCount), argCount)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				LOAD_FRAME();
+				DISPATCH();
+			}
+			if (!IS_INSTANCE(PEEK(argCount))) {
+				RUNTIME_ERROR("Only instances have properties.");
+			}
+
+			ObjInstance* instance = AS_INSTANCE(PEEK(argCount));
+			CacheEntry* entry = findCacheEntry(cache, instance->shape);
+			if (entry == NULL || (entry->slot == -1 && entry->methodVersion != instance->klass->methodVersion)) {
+				STORE_FRAME();
+				entry = cacheGetProperty(cache, instance, name);
+				if (entry == NULL) return INTERPRET_RUNTIME_ERROR;
 			}
 
-			currentFrame = &vm.frames[vm.frameCount - 1];
-			break;
+			if (entry->slot != -1) {
+				//A field shadowing the method is called like any other value
+				PEEK(argCount) = instance->fields[entry->slot];
+				STORE_FRAME();
+				if (!callValue(PEEK(argCount), argCount)) {
+					return INTERPRET_RUNTIME_ERROR;
+				}
+				LOAD_FRAME();
+				DISPATCH();
+			}
+
+			ObjFunction* function = entry->method->function;
+			if (tail && argCount <= function->arity && argCount >= function->arity - function->defaults) {
+				REUSE_FRAME(entry->method, argCount);
+				LOAD_FRAME();
+				DISPATCH();
+			}
+
+			STORE_FRAME();
+			if (!call(entry->method, argCount)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			LOAD_FRAME();
+			DISPATCH();
 		}
 
-		case OP_RETURN: {
-			Value result = pop();
-			closeUpvariable(currentFrame->frameSlots);
+		CASE(OP_RETURN): {
+			Value result = POP();
+			closeFrameUpvalues(currentFrame);
 			vm.frameCount--;
 			if (vm.frameCount == 0) {
-				pop();
+				vm.stackPtr = stackTop - 1;
 				return INTERPRET_OK;
 			}
-			vm.stackPtr = currentFrame->frameSlots;
+			vm.stackPtr = frameSlots;
 			push(result);
-			currentFrame = &vm.frames[vm.frameCount - 1];
-			break;
+			LOAD_FRAME();
+			DISPATCH();
 		}
 #pragma endregion
 
 #pragma region Classes
-		case OP_CLASS: {
-			push(OBJ_VAL(newClass(READ_STRING())));
-			break;
+		CASE(OP_CLASS): {
+			vm.stackPtr = stackTop;
+			PUSH(OBJ_VAL(newClass(READ_STRING())));
+			DISPATCH();
 		}
-		case OP_GET_PROPERTY: {
-			if (!IS_INSTANCE(peek(0))) {
-				runtimeError("Only instances have properties.");
-				return INTERPRET_RUNTIME_ERROR;
+		CASE(OP_GET_PROPERTY):
+		getProperty: {
+			if (IS_STRUCT(PEEK(0))) {
+				ObjStruct* value = AS_STRUCT(PEEK(0));
+				ObjString* name = READ_STRING();
+				ip += 2;
+				int field = structFieldIndex(value->type, name);
+				if (field == -1) {
+					RUNTIME_ERROR("Undefined property '%s'.", name->chars);
+				}
+				PEEK(0) = value->fields[field];
+				DISPATCH();
+			}
+			if (!IS_INSTANCE(PEEK(0))) {
+				RUNTIME_ERROR("Only instances have properties.");
 			}
 
-			ObjInstance* instance = AS_INSTANCE(peek(0));
+			ObjInstance* instance = AS_INSTANCE(PEEK(0));
 			ObjString* name = READ_STRING();
+			PropertyCache* cache = READ_CACHE();
 
-			Value value;
-			if (tableGet(&instance->fields, name, &value)) {
-				pop();
-				push(value);
-				break;
+			CacheEntry* entry = findCacheEntry(cache, instance->shape);
+			if (entry == NULL || (entry->slot == -1 && entry->methodVersion != instance->klass->methodVersion)) {
+				STORE_FRAME();
+				entry = cacheGetProperty(cache, instance, name);
+				if (entry == NULL) return INTERPRET_RUNTIME_ERROR;
 			}
 
-			if (!bindMethod(instance->klass, name)) {
-				return INTERPRET_RUNTIME_ERROR;
+			if (entry->slot != -1) {
+				PEEK(0) = instance->fields[entry->slot];
+				DISPATCH();
 			}
-			break;
+
+			vm.stackPtr = stackTop;
+			ObjBoundMethod* boundMethod = newBoundMethod(PEEK(0), entry->method);
+			PEEK(0) = OBJ_VAL(boundMethod);
+			DISPATCH();
 		}
-		case OP_SET_PROPERTY: {
-			if (!IS_INSTANCE(peek(1))) {
-				runtimeError("Only instances have fields.");
-				return INTERPRET_RUNTIME_ERROR;
+		CASE(OP_SET_PROPERTY):
+		setProperty: {
+			if (IS_STRUCT(PEEK(1))) {
+				ObjStruct* value = AS_STRUCT(PEEK(1));
+				ObjString* name = READ_STRING();
+				ip += 2;
+				int field = structFieldIndex(value->type, name);
+				if (field == -1) {
+					RUNTIME_ERROR("Undefined property '%s'.", name->chars);
+				}
+				value->fields[field] = PEEK(0);
+
+				Value assigned = POP();
+				PEEK(0) = assigned;
+				DISPATCH();
+			}
+			if (!IS_INSTANCE(PEEK(1))) {
+				RUNTIME_ERROR("Only instances have fields.");
 			}
 
-			ObjInstance* instance = AS_INSTANCE(peek(1));
-			tableSet(&instance->fields, READ_STRING(), peek(0));
-			
-			Value popped = pop();
-			pop();
-			push(popped);
-			break;
+			ObjInstance* instance = AS_INSTANCE(PEEK(1));
+			ObjString* name = READ_STRING();
+			PropertyCache* cache = READ_CACHE();
+
+			CacheEntry* entry = findCacheEntry(cache, instance->shape);
+			if (entry == NULL) {
+				vm.stackPtr = stackTop;
+				entry = cacheSetProperty(cache, instance, name);
+			}
+			if (entry->transition != NULL) {
+				vm.stackPtr = stackTop;
+				reserveFields(instance, entry->transition->slotCount);
+				instance->shape = entry->transition;
+			}
+			instance->fields[entry->slot] = PEEK(0);
+
+			Value value = POP();
+			PEEK(0) = value;
+			DISPATCH();
 		}
-		case OP_METHOD:
+		CASE(OP_GET_FIELD):
+		getField: {
+			uint8_t field = READ_BYTE();
+			if (IS_STRUCT(PEEK(0))) {
+				ObjStruct* value = AS_STRUCT(PEEK(0));
+				if (field < value->type->fieldCount && value->type->fieldNames[field] == AS_STRING(constants[ip[0]])) {
+					ip += 3;
+					PEEK(0) = value->fields[field];
+					DISPATCH();
+				}
+			}
+			goto getProperty;
+		}
+		CASE(OP_SET_FIELD): {
+			uint8_t field = READ_BYTE();
+			if (IS_STRUCT(PEEK(1))) {
+				ObjStruct* value = AS_STRUCT(PEEK(1));
+				if (field < value->type->fieldCount && value->type->fieldNames[field] == AS_STRING(constants[ip[0]])) {
+					ip += 3;
+					value->fields[field] = PEEK(0);
+
+					Value assigned = POP();
+					PEEK(0) = assigned;
+					DISPATCH();
+				}
+			}
+			goto setProperty;
+		}
+		CASE(OP_METHOD):
+			vm.stackPtr = stackTop;
 			defineMethod(READ_STRING());
-			break;
+			stackTop = vm.stackPtr;
+			DISPATCH();
+		CASE(OP_INHERIT): {
+			if (!IS_CLASS(PEEK(1))) {
+				RUNTIME_ERROR("Superclass must be a class.");
+			}
+
+			//Copied down once, so method lookups never walk up the hierarchy
+			ObjClass* subclass = AS_CLASS(PEEK(0));
+			vm.stackPtr = stackTop;
+			tableAddAll(&AS_CLASS(PEEK(1))->methods, &subclass->methods);
+			subclass->methodVersion++;
+			subclass->initializer = AS_CLASS(PEEK(1))->initializer;
+			DROP(1);
+			DISPATCH();
+		}
+		CASE(OP_GET_SUPER):
+		CASE(OP_SUPER_INVOKE): {
+			bool invoke = ip[-1] == OP_SUPER_INVOKE;
+			ObjString* name = READ_STRING();
+			PropertyCache* cache = READ_CACHE();
+			int argCount = invoke ? READ_BYTE() : 0;
+			ObjClass* superclass = AS_CLASS(POP());
+
+			CacheEntry* entry = findCacheEntry(cache, superclass->rootShape);
+			if (entry == NULL || entry->methodVersion != superclass->methodVersion) {
+				STORE_FRAME();
+				entry = cacheSuperMethod(cache, superclass, name);
+				if (entry == NULL) return INTERPRET_RUNTIME_ERROR;
+			}
+
+			if (!invoke) {
+				vm.stackPtr = stackTop;
+				ObjBoundMethod* boundMethod = newBoundMethod(PEEK(0), entry->method);
+				PEEK(0) = OBJ_VAL(boundMethod);
+				DISPATCH();
+			}
+
+			STORE_FRAME();
+			if (!call(entry->method, argCount)) {
+				return INTERPRET_RUNTIME_ERROR;
+			}
+			LOAD_FRAME();
+			DISPATCH();
+		}
 #pragma endregion
+
+#pragma region Superinstructions
+		CASE(OP_GET_LOCAL_CONSTANT): {
+			uint8_t slot = READ_BYTE();
+			PUSH(frameSlots[slot]);
+			PUSH(READ_CONSTANT());
+			DISPATCH();
 		}
+		CASE(OP_GET_LOCAL_GET_LOCAL): {
+			uint8_t first = READ_BYTE();
+			uint8_t second = READ_BYTE();
+			PUSH(frameSlots[first]);
+			PUSH(frameSlots[second]);
+			DISPATCH();
+		}
+		CASE(OP_GET_LOCAL_PROPERTY): {
+			uint8_t slot = READ_BYTE();
+			PUSH(frameSlots[slot]);
+			goto getProperty;
+		}
+		CASE(OP_GET_LOCAL_FIELD): {
+			uint8_t slot = READ_BYTE();
+			PUSH(frameSlots[slot]);
+			goto getField;
+		}
+		CASE(OP_SET_LOCAL_POP): {
+			uint8_t slot = READ_BYTE();
+			frameSlots[slot] = POP();
+			DISPATCH();
+		}
+		CASE(OP_JUMP_IF_FALSE_POP): {
+			uint16_t jumpOffset = READ_SHORT();
+			if (isFalse(POP()))
+				ip += jumpOffset;
+			DISPATCH();
+		}
+#pragma endregion
 	}
+	//Every handler dispatches or returns, only an unknown opcode leaves the switch
+	return INTERPRET_RUNTIME_ERROR;
 	
 
+#undef INTERPRET_LOOP
+#undef PROFILE_INSTRUCTION
+#undef DISPATCH
+#undef CASE
 #undef BINARY_OP
+#undef NUMBER_OP
+#undef INT_OP
+#undef MOD_OP
+#undef BITWISE_OP
+#undef REGISTER_OP
+#undef REGISTER_ADD
+#undef REGISTER_MOD
+#undef INCREMENT
+#undef ADD_SET
+#undef REUSE_FRAME
+#undef RUNTIME_ERROR
+#undef DROP
+#undef PEEK
+#undef POP
+#undef PUSH
+#undef GLOBAL_NAME
+#undef READ_CACHE
 #undef READ_SHORT
 #undef READ_STRING
 #undef READ_CONSTANT
 #undef READ_BYTE
+#undef LOAD_FRAME
+#undef STORE_FRAME
 }
@@ -6,17 +6,22 @@
 #include "table.h"
 #include "object.h"
 
-#define FRAMES_MAX 64
-#define STACK_MAX (FRAMES_MAX * UINT8_MAX)
+//Both stacks start small and grow on demand
+#define FRAMES_INITIAL 16
+#define STACK_INITIAL 1024
+//Free slots guaranteed above the base of every frame: the locals and temporaries of one function,
+//plus the pushes of the VM's slow paths. PUSH and push() rely on it and never check.
+#define FRAME_STACK_SLOTS ((UINT8_MAX + 1) * 2)
+//Default for vm.maxFrames (--max-frames)
+#define FRAMES_MAX_DEFAULT 10000
 
 
 typedef struct {
 	ObjClosure* closure;
 	uint8_t* ip;
 	Value* frameSlots;
-	Value* defaultsStart;
-	//Defaults required (i.e., non instantiated at call)
-	int defaultsRequired;
+	//Upvalues still open over the slots of this frame
+	int openUpvalues;
 } CallFrame;
 
 
@@ -27,24 +32,37 @@ typedef enum {
 } InterpretResult;
 
 typedef struct {
-	CallFrame frames[FRAMES_MAX];
+	CallFrame* frames;
 	int frameCount;
+	int frameCapacity;
+	//Deeper calls fail with a stack overflow error
+	int maxFrames;
 
-	ObjUpvalue* openUpvalues;
+	//Open upvalue of each stack slot, NULL where there is none. Sized like the stack.
+	ObjUpvalue** openUpvalues;
 
 	//Value stack
-	Value stack[STACK_MAX];
+	Value* stack;
 	Value* stackPtr;
+	int stackCapacity;
 	//Array of objects to be freed
 	Obj* objects;
 	//Interning strings
 	Table internStrings;
-	//Variables
-	Table globals;
+	//Global variables, resolved to slots of globalValues at compile time.
+	//globalSlots maps names to slots, globalNames keeps the name of each slot for errors.
+	Table globalSlots;
+	ValueArray globalValues;
+	ValueArray globalNames;
 
 	//Classes
 	ObjString* initString;
 
+	//Debugging (--trace): disassemble every compiled chunk and executed instruction
+	bool traceExecution;
+	//--register: compile straight-line local arithmetic to three-address register ops
+	bool registerBackend;
+
 	//GC
 	int grayCapacity;
 	int grayCount;
@@ -59,6 +77,8 @@ extern VM vm;
 void initVM();
 void freeVM();
 
+int globalSlot(ObjString* name);
+
 InterpretResult interpret(char* source);
 InterpretResult run();
 